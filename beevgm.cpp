@@ -16,6 +16,8 @@
     along with BeeVGM.  If not, see <https://www.gnu.org/licenses/>.
 */
 
+#include <algorithm>
+#include <limits>
 #include "beevgm.h"
 using namespace beevgm;
 using namespace std;
@@ -30,87 +32,476 @@ BeeVGM::~BeeVGM()
 
 }
 
+// Takes ownership of 'memory' (which can be gzip-compressed)
 bool BeeVGM::load(vector<uint8_t> memory)
 {
-    vgm_data = memory;
+    reset();
+
+    if (!vgm_loader.assign(move(memory)))
+    {
+	return false;
+    }
+
     return parseheader();
 }
 
-bool BeeVGM::parseheader()
+// Plays straight from memory owned by the caller, which must be kept
+// alive for as long as it's being played (unless it's gzip-compressed,
+// in which case the decompressed data is owned by the engine instead)
+bool BeeVGM::load(const uint8_t *data, size_t size)
 {
-    if (vgm_data.size() < 64)
+    reset();
+
+    if (!vgm_loader.borrow(data, size))
     {
 	return false;
     }
 
-    if (vgm_data[0] != 'V' || vgm_data[1] != 'g' || vgm_data[2] != 'm' || vgm_data[3] != ' ')
+    return parseheader();
+}
+
+// Memory-maps a .vgm file, or starts decompressing a .vgz file
+// (the rest of which is decompressed as it's played)
+bool BeeVGM::loadFile(string filename)
+{
+    reset();
+
+    if (!vgm_loader.open(filename))
     {
-	cout << "Data does not appear to be valid VGM data." << endl;
 	return false;
     }
 
-    vgm_loop_offset = readLong(0x1C);
-    vgm_version = readLong(0x8);
-    vgm_pos = fetch_start();
+    return parseheader();
+}
 
-    uint32_t gd3_offs = readLong(0x14);
+void BeeVGM::reset()
+{
+    vgm_loader.close();
+    vgm_data = BeeVGMSpan();
+    vgm_tag.close();
+    keyframes.clear();
+    is_index_done = false;
+    pcm_banks.clear();
+    pcm_blocks_loaded = 0;
+    chip_tap = nullptr;
+
+    file_id = 0;
+    reset_playback();
+}
 
-    if (gd3_offs != 0)
+bool BeeVGM::reload()
+{
+    if (vgm_data.empty())
     {
-	gd3_pos = (0x14 + gd3_offs);
+	return false;
     }
 
-    parseGD3();
+    reset_playback();
+    detect_standard_features();
+    detect_extra_features();
+    return true;
+}
+
+// The PCM banks are kept, since data blocks are loaded the same way every time
+// (just like when looping), but the chips have to get their ROMs again
+void BeeVGM::reset_playback()
+{
+    cmd_pos = 0;
+    pending_samples = 0;
+    end_of_stream = false;
+    is_ymfm_auto = false;
+    pcm_pos = 0;
+    sample_pos = 0;
+    dac_streams.reset();
+
+    snpsg_chip.reset();
+    opll_chip.reset();
+    opn2_chips.reset();
+    opm_chip.reset();
+    opn_chip.reset();
+    opnb_chip.reset();
+    opl_chip.reset();
+    opl_msx_chip.reset();
+    opl2_chip.reset();
+    opl3_chip.reset();
+    segapcm_chip.reset();
+    ymz280b_chip.reset();
+    rf5c68_chip.reset();
+    multipcm_chips.reset();
+}
+
+// The loader has already checked the header, so this just sets up for playback
+bool BeeVGM::parseheader()
+{
+    vgm_data = vgm_loader.span();
+
+    file_id = fetch_file_id();
+
+    // The GD3 tag comes at the end, so for compressed files,
+    // it's read once the whole file has been decompressed
+    if (vgm_loader.is_complete())
+    {
+	parseGD3();
+    }
 
     if (is_at_least(1, 70))
     {
-	cout << "Warning: version > 1.61 detected, some things may not work properly!" << endl;
+	BEEVGM_LOG(LogWarning, "Version > 1.61 detected, some things may not work properly!");
     }
     else
     {
-	cout << fetch_version_str(is_at_least(1, 51)) << endl;
+	BEEVGM_LOG(LogInfo, fetch_version_str(is_at_least(1, 51)));
     }
 
     detect_standard_features();
     detect_extra_features();
 
+    dac_streams.init(pcm_banks, [this](const BeeVGMCommand &cmd) {
+	writeChip(cmd);
+    });
+
     return true;
 }
 
+// Decompresses (and compiles the commands in) the next chunk of a compressed file,
+// returning false once there's nothing left to load
+bool BeeVGM::loadMoreData()
+{
+    if (!vgm_loader.load_more(pcm_banks))
+    {
+	return false;
+    }
+
+    vgm_data = vgm_loader.span();
+
+    if (vgm_loader.is_complete())
+    {
+	parseGD3();
+    }
+
+    return true;
+}
+
+bool BeeVGM::isLoadComplete()
+{
+    return vgm_loader.is_complete();
+}
+
 void BeeVGM::parseGD3()
 {
-    if (vgm_tag.open(vgm_data, gd3_pos))
+    if (vgm_tag.open(vgm_data, vgm_loader.get_gd3_offset()))
     {
-	cout << "GD3 found" << endl;
+	BEEVGM_LOG(LogInfo, "GD3 found");
     }
 }
 
-BeeGD3 BeeVGM::getGD3Tag()
+const BeeGD3 &BeeVGM::getGD3Tag()
 {
+    // Decompresses the rest of the file, if needed
+    while (loadMoreData())
+    {
+	continue;
+    }
+
     return vgm_tag;
 }
 
 uint32_t BeeVGM::getLoopOffset()
 {
-    if (vgm_loop_offset == 0)
+    return vgm_loader.get_loop_offset();
+}
+
+void BeeVGM::seekLoop(uint32_t offset)
+{
+    size_t prev_cmd_pos = cmd_pos;
+    cmd_pos = vgm_loader.get_commands().find_offset(offset);
+
+    // Loops would only add keyframes for states the first pass already has
+    is_index_done = true;
+
+    if (end_of_stream && (cmd_pos < prev_cmd_pos))
     {
-	return 0;
+	end_of_stream = false;
+    }
+}
+
+// With the seek index enabled, render() saves a keyframe (a copy of the
+// whole engine's state) every 'keyframe_interval' samples during the
+// first pass through the file, i.e. until playback first ends or loops.
+// Seeking goes back to the last keyframe at or before the target, and
+// plays on from there, so a seek within the first pass costs at most one
+// interval's worth of emulation, wherever it lands (and one past it
+// plays on from the last keyframe).
+//
+// Every keyframe holds a copy of every chip, including any ROM loaded
+// into it (the cores keep their ROMs to themselves), so files with large
+// ROMs are better off with longer intervals. Saved states taken at a
+// keyframe share its copies instead
+bool BeeVGM::enableSeekIndex(uint32_t interval)
+{
+    // The first keyframe has to be the start of the file
+    if ((sample_pos != 0) || (interval == 0))
+    {
+	return false;
+    }
+
+    keyframe_interval = interval;
+    is_index_done = false;
+    keyframes.clear();
+    keyframes.emplace_back();
+    saveKeyframe(keyframes.back());
+    return true;
+}
+
+bool BeeVGM::buildSeekIndex(uint32_t interval)
+{
+    if (!enableSeekIndex(interval))
+    {
+	return false;
+    }
+
+    skipSamples(numeric_limits<uint64_t>::max());
+    return seek(0);
+}
+
+bool BeeVGM::seek(uint64_t sample_index)
+{
+    auto next_keyframe = upper_bound(keyframes.begin(), keyframes.end(), sample_index, [](uint64_t pos, const BeeVGMKeyframe &keyframe) {
+	return (pos < keyframe.sample_pos);
+    });
+
+    bool is_ahead = (sample_index >= sample_pos);
+
+    if (next_keyframe != keyframes.begin())
+    {
+	const BeeVGMKeyframe &keyframe = *prev(next_keyframe);
+
+	// Just plays on if the keyframe isn't any closer than where we already are
+	if (!is_ahead || (keyframe.sample_pos > sample_pos))
+	{
+	    loadKeyframe(keyframe);
+	}
+    }
+    else if (!is_ahead)
+    {
+	return false;
+    }
+
+    skipSamples((sample_index - sample_pos));
+    return (sample_pos == sample_index);
+}
+
+uint64_t BeeVGM::getPosition()
+{
+    return sample_pos;
+}
+
+// Only waits count towards the length, so this is just a sum over the
+// compiled commands, up to the end of the stream (or the first command
+// that would stop playback), with the loop covering everything from the
+// first command at or after the loop offset
+BeeVGMScanInfo BeeVGM::scan()
+{
+    // Decompresses (and compiles) the rest of the file, if needed
+    while (loadMoreData())
+    {
+	continue;
+    }
+
+    BeeVGMScanInfo info;
+    const BeeVGMCommandStream &commands = vgm_loader.get_commands();
+
+    uint32_t loop_offs = getLoopOffset();
+    size_t loop_index = (loop_offs != 0) ? commands.find_offset(loop_offs) : commands.size();
+
+    for (size_t index = 0; index < commands.size(); index++)
+    {
+	const BeeVGMCommand &cmd = commands.at(index);
+
+	if ((cmd.type == CmdEnd) || (cmd.type == CmdUnknown))
+	{
+	    break;
+	}
+
+	if ((cmd.type != CmdWait) && (cmd.type != CmdDACWrite))
+	{
+	    continue;
+	}
+
+	info.total_samples += cmd.wait;
+
+	if (index >= loop_index)
+	{
+	    info.loop_samples += cmd.wait;
+	}
+    }
+
+    auto to_ms = [](uint64_t num_samples) -> uint64_t {
+	return (((num_samples * 1000) + 22050) / 44100);
+    };
+
+    info.total_ms = to_ms(info.total_samples);
+    info.loop_ms = to_ms(info.loop_samples);
+    info.is_looped = (info.loop_samples != 0);
+
+    info.header_total_samples = readLong(0x18);
+    info.header_loop_samples = readLong(0x20);
+    info.is_header_match = ((info.header_total_samples == info.total_samples) && (info.header_loop_samples == info.loop_samples));
+
+    if (!info.is_header_match)
+    {
+	BEEVGM_LOG(LogWarning, "Header lengths (" << dec << info.header_total_samples << " total, " << info.header_loop_samples << " loop samples) don't match the commands (" << info.total_samples << " total, " << info.loop_samples << " loop samples)");
+    }
+
+    return info;
+}
+
+BeeVGMState BeeVGM::saveState()
+{
+    auto keyframe = make_shared<BeeVGMKeyframe>();
+
+    auto index_keyframe = lower_bound(keyframes.begin(), keyframes.end(), sample_pos, [](const BeeVGMKeyframe &keyframe, uint64_t pos) {
+	return (keyframe.sample_pos < pos);
+    });
+
+    // Playback that's sitting on a keyframe (say, straight after a seek to it) is
+    // saved by sharing the keyframe's chips, rather than copying them (and their ROMs) again
+    if ((index_keyframe != keyframes.end()) && (index_keyframe->sample_pos == sample_pos) && (index_keyframe->cmd_pos == cmd_pos))
+    {
+	*keyframe = *index_keyframe;
     }
     else
     {
-	return (0x1C + vgm_loop_offset);
+	saveKeyframe(*keyframe);
     }
+
+    BeeVGMState state;
+    state.keyframe = keyframe;
+    state.file_id = file_id;
+    return state;
 }
 
-void BeeVGM::seekLoop(uint32_t offset)
+bool BeeVGM::loadState(const BeeVGMState &state)
+{
+    if (!state.is_valid() || (state.file_id != file_id))
+    {
+	return false;
+    }
+
+    loadKeyframe(*state.keyframe);
+    return true;
+}
+
+// FNV-1a hash of the header (plus the file size and GD3 offsets in it)
+uint64_t BeeVGM::fetch_file_id()
 {
-    uint32_t prev_vgm_pos = vgm_pos;
-    vgm_pos = offset;
+    size_t header_size = min<size_t>(vgm_loader.get_data_offset(), vgm_data.size());
+    uint64_t hash = 0xCBF29CE484222325ULL;
 
-    if (end_of_stream && (vgm_pos < prev_vgm_pos))
+    for (size_t index = 0; index < header_size; index++)
     {
-	end_of_stream = false;
+	hash ^= vgm_data[index];
+	hash *= 0x100000001B3ULL;
+    }
+
+    return hash;
+}
+
+// Renders (and throws away) up to 'num_samples' samples, and returns the
+// number actually rendered (which is less only if the stream ends first)
+uint64_t BeeVGM::skipSamples(uint64_t num_samples)
+{
+    array<int16_t, (max_block_frames * 2)> skip_buffer;
+    uint64_t samples_done = 0;
+
+    while (samples_done < num_samples)
+    {
+	size_t block_frames = size_t(min<uint64_t>((num_samples - samples_done), max_block_frames));
+	size_t frames_done = render(skip_buffer.data(), block_frames);
+	samples_done += frames_done;
+
+	if (frames_done < block_frames)
+	{
+	    break;
+	}
     }
+
+    return samples_done;
+}
+
+void BeeVGM::saveKeyframe(BeeVGMKeyframe &keyframe)
+{
+    keyframe.sample_pos = sample_pos;
+    keyframe.cmd_pos = cmd_pos;
+    keyframe.pending_samples = pending_samples;
+    keyframe.end_of_stream = end_of_stream;
+    keyframe.is_ymfm_auto = is_ymfm_auto;
+
+    keyframe.pcm_pos = pcm_pos;
+    keyframe.pcm_blocks_loaded = pcm_blocks_loaded;
+    keyframe.pcm_mark = pcm_banks.get_mark();
+    keyframe.dac_streams = dac_streams.get_streams();
+
+    snpsg_chip.save_snapshot(keyframe.snpsg_chip);
+    opll_chip.save_snapshot(keyframe.opll_chip);
+    opn2_chips.save_snapshot(keyframe.opn2_chips);
+    opm_chip.save_snapshot(keyframe.opm_chip);
+    opn_chip.save_snapshot(keyframe.opn_chip);
+    opnb_chip.save_snapshot(keyframe.opnb_chip);
+    opl_chip.save_snapshot(keyframe.opl_chip);
+    opl_msx_chip.save_snapshot(keyframe.opl_msx_chip);
+    opl2_chip.save_snapshot(keyframe.opl2_chip);
+    opl3_chip.save_snapshot(keyframe.opl3_chip);
+    segapcm_chip.save_snapshot(keyframe.segapcm_chip);
+    ymz280b_chip.save_snapshot(keyframe.ymz280b_chip);
+    rf5c68_chip.save_snapshot(keyframe.rf5c68_chip);
+    multipcm_chips.save_snapshot(keyframe.multipcm_chips);
+}
+
+void BeeVGM::loadKeyframe(const BeeVGMKeyframe &keyframe)
+{
+    // A state saved by another engine can be further along in a compressed file than this one
+    while ((vgm_loader.get_commands().size() < keyframe.cmd_pos) && loadMoreData())
+    {
+	continue;
+    }
+
+    sample_pos = keyframe.sample_pos;
+    cmd_pos = keyframe.cmd_pos;
+    pending_samples = keyframe.pending_samples;
+    end_of_stream = keyframe.end_of_stream;
+    is_ymfm_auto = keyframe.is_ymfm_auto;
+
+    pcm_pos = keyframe.pcm_pos;
+
+    // Data blocks are always loaded in the same order, so the banks
+    // only need to be cut back to (or caught up with) the keyframe
+    if (keyframe.pcm_blocks_loaded < pcm_blocks_loaded)
+    {
+	pcm_banks.rewind(keyframe.pcm_mark);
+	pcm_blocks_loaded = keyframe.pcm_blocks_loaded;
+    }
+    else
+    {
+	loadPCMBlocks(keyframe.pcm_blocks_loaded);
+    }
+
+    dac_streams.set_streams(keyframe.dac_streams);
+
+    snpsg_chip.load_snapshot(keyframe.snpsg_chip);
+    opll_chip.load_snapshot(keyframe.opll_chip);
+    opn2_chips.load_snapshot(keyframe.opn2_chips);
+    opm_chip.load_snapshot(keyframe.opm_chip);
+    opn_chip.load_snapshot(keyframe.opn_chip);
+    opnb_chip.load_snapshot(keyframe.opnb_chip);
+    opl_chip.load_snapshot(keyframe.opl_chip);
+    opl_msx_chip.load_snapshot(keyframe.opl_msx_chip);
+    opl2_chip.load_snapshot(keyframe.opl2_chip);
+    opl3_chip.load_snapshot(keyframe.opl3_chip);
+    segapcm_chip.load_snapshot(keyframe.segapcm_chip);
+    ymz280b_chip.load_snapshot(keyframe.ymz280b_chip);
+    rf5c68_chip.load_snapshot(keyframe.rf5c68_chip);
+    multipcm_chips.load_snapshot(keyframe.multipcm_chips);
 }
 
 void BeeVGM::detect_standard_features()
@@ -149,7 +540,7 @@ void BeeVGM::detect_standard_features()
     {
 	if (ym2413_clk != 0)
 	{
-	    cout << "Auto-detecting FM sound chip..." << endl;
+	    BEEVGM_LOG(LogInfo, "Auto-detecting FM sound chip...");
 	    is_ymfm_auto = true;
 	}
     }
@@ -249,138 +640,138 @@ void BeeVGM::detect_v161_features()
 
 void BeeVGM::init_sn76489()
 {
-    cout << "SN76489 detected" << endl;
+    BEEVGM_LOG(LogInfo, "SN76489 detected");
     uint32_t snpsg_clk = readLong(0xC);
     snpsg_clk &= 0x3FFFFFFF;
-    int noisefb = vgm_version < 0x110 ? 9 : readWord(0x28);
-    int lfsrbitwidth = vgm_version < 0x110 ? 16 : readByte(0x2A);
+    int noisefb = vgm_loader.get_version() < 0x110 ? 9 : readWord(0x28);
+    int lfsrbitwidth = vgm_loader.get_version() < 0x110 ? 16 : readByte(0x2A);
     uint32_t flags = ((noisefb << 16) | (lfsrbitwidth << 8));
-    cout << "Setting SN76489 clock rate to " << dec << (int)snpsg_clk << " Hz" << endl;
+    BEEVGM_LOG(LogInfo, "Setting SN76489 clock rate to " << dec << (int)snpsg_clk << " Hz");
     snpsg_chip.init(snpsg_clk);
     snpsg_chip.config(flags);
 }
 
 void BeeVGM::init_ym2413()
 {
-    cout << "YM2413 detected" << endl;
+    BEEVGM_LOG(LogInfo, "YM2413 detected");
     uint32_t ym2413_clk = readLong(0x10);
     ym2413_clk &= 0x3FFFFFFF;
-    cout << "Setting YM2413 clock rate to " << dec << (int)ym2413_clk << " Hz" << endl;
+    BEEVGM_LOG(LogInfo, "Setting YM2413 clock rate to " << dec << (int)ym2413_clk << " Hz");
     opll_chip.init(ym2413_clk);
     is_ymfm_auto = false;
 }
 
 void BeeVGM::init_ym2612()
 {
-    cout << "YM2612 detected" << endl;
+    BEEVGM_LOG(LogInfo, "YM2612 detected");
     uint32_t ym2612_clk = is_at_least(1, 10) ? readLong(0x2C) : readLong(0x10);
     uint32_t clk_masked = (ym2612_clk & 0x3FFFFFFF);
-    cout << "Setting YM2612 clock rate to " << dec << int(clk_masked) << " Hz" << endl;
+    BEEVGM_LOG(LogInfo, "Setting YM2612 clock rate to " << dec << int(clk_masked) << " Hz");
     opn2_chips.init(ym2612_clk);
     is_ymfm_auto = false;
 }
 
 void BeeVGM::init_ym2151()
 {
-    cout << "YM2151 detected" << endl;
+    BEEVGM_LOG(LogInfo, "YM2151 detected");
     uint32_t ym2151_clk = is_at_least(1, 10) ? readLong(0x30) : readLong(0x10);
     ym2151_clk &= 0x3FFFFFFF;
-    cout << "Setting YM2151 clock rate to " << dec << (int)ym2151_clk << " Hz" << endl;
+    BEEVGM_LOG(LogInfo, "Setting YM2151 clock rate to " << dec << (int)ym2151_clk << " Hz");
     opm_chip.init(ym2151_clk);
     is_ymfm_auto = false;
 }
 
 void BeeVGM::init_segapcm()
 {
-    cout << "SegaPCM detected" << endl;
+    BEEVGM_LOG(LogInfo, "SegaPCM detected");
     uint32_t segapcm_clk = readLong(0x38);
     segapcm_clk &= 0x3FFFFFFF;
-    cout << "Setting SegaPCM clock rate to " << dec << int(segapcm_clk) << " Hz" << endl;
+    BEEVGM_LOG(LogInfo, "Setting SegaPCM clock rate to " << dec << int(segapcm_clk) << " Hz");
     uint32_t inter_reg = readLong(0x3C);
-    cout << "Setting SegaPCM interface register to " << hex << int(inter_reg) << endl;
+    BEEVGM_LOG(LogInfo, "Setting SegaPCM interface register to " << hex << int(inter_reg));
     segapcm_chip.init(segapcm_clk);
     segapcm_chip.config(inter_reg);
 }
 
 void BeeVGM::init_ym2203()
 {
-    cout << "YM2203 detected" << endl;
+    BEEVGM_LOG(LogInfo, "YM2203 detected");
     uint32_t ym2203_clk = readLong(0x44);
     ym2203_clk &= 0x3FFFFFFF;
-    cout << "Setting YM2203 clock to " << dec << ym2203_clk << " Hz" << endl;
+    BEEVGM_LOG(LogInfo, "Setting YM2203 clock to " << dec << ym2203_clk << " Hz");
     opn_chip.init(ym2203_clk);
 }
 
 void BeeVGM::init_ym2610()
 {
-    cout << "YM2610 detected" << endl;
+    BEEVGM_LOG(LogInfo, "YM2610 detected");
     uint32_t ym2610_clk = readLong(0x4C);
     ym2610_clk &= 0x3FFFFFFF;
-    cout << "Setting YM2610 clock to " << dec << ym2610_clk << " Hz" << endl;
+    BEEVGM_LOG(LogInfo, "Setting YM2610 clock to " << dec << ym2610_clk << " Hz");
     opnb_chip.init(ym2610_clk);
 }
 
 void BeeVGM::init_ym3812()
 {
-    cout << "YM3812 detected" << endl;
+    BEEVGM_LOG(LogInfo, "YM3812 detected");
     uint32_t ym3812_clk = readLong(0x50);
     ym3812_clk &= 0x3FFFFFFF;
-    cout << "Setting YM3812 clock to " << dec << ym3812_clk << " Hz" << endl;
+    BEEVGM_LOG(LogInfo, "Setting YM3812 clock to " << dec << ym3812_clk << " Hz");
     opl2_chip.init(ym3812_clk);
 }
 
 void BeeVGM::init_ym3526()
 {
-    cout << "YM3526 detected" << endl;
+    BEEVGM_LOG(LogInfo, "YM3526 detected");
     uint32_t ym3526_clk = readLong(0x54);
     ym3526_clk &= 0x3FFFFFFF;
-    cout << "Setting YM3526 clock to " << dec << ym3526_clk << " Hz" << endl;
+    BEEVGM_LOG(LogInfo, "Setting YM3526 clock to " << dec << ym3526_clk << " Hz");
     opl_chip.init(ym3526_clk);
 }
 
 void BeeVGM::init_y8950()
 {
-    cout << "Y8950 detected" << endl;
+    BEEVGM_LOG(LogInfo, "Y8950 detected");
     uint32_t y8950_clk = readLong(0x58);
     y8950_clk &= 0x3FFFFFFF;
-    cout << "Setting Y8950 clock to " << dec << y8950_clk << " Hz" << endl;
+    BEEVGM_LOG(LogInfo, "Setting Y8950 clock to " << dec << y8950_clk << " Hz");
     opl_msx_chip.init(y8950_clk);
 }
 
 void BeeVGM::init_ymf262()
 {
-    cout << "YMF262 detected" << endl;
+    BEEVGM_LOG(LogInfo, "YMF262 detected");
     uint32_t ymf262_clk = readLong(0x5C);
     ymf262_clk &= 0x3FFFFFFF;
-    cout << "Setting YMF262 clock to " << dec << ymf262_clk << " Hz" << endl;
+    BEEVGM_LOG(LogInfo, "Setting YMF262 clock to " << dec << ymf262_clk << " Hz");
     opl3_chip.init(ymf262_clk);
 }
 
 void BeeVGM::init_ymz280b()
 {
-    cout << "YMZ280B detected" << endl;
+    BEEVGM_LOG(LogInfo, "YMZ280B detected");
     uint32_t ymz280b_clk = readLong(0x68);
     ymz280b_clk &= 0x3FFFFFFF;
-    cout << "Setting YMZ280B clock to " << dec << ymz280b_clk << " Hz" << endl;
+    BEEVGM_LOG(LogInfo, "Setting YMZ280B clock to " << dec << ymz280b_clk << " Hz");
     ymz280b_chip.init(ymz280b_clk);
 }
 
 void BeeVGM::init_rf5c68()
 {
-    cout << "Ricoh RF5C68 detected" << endl;
+    BEEVGM_LOG(LogInfo, "Ricoh RF5C68 detected");
 
     uint32_t rf5c68_clk = readLong(0x40);
     rf5c68_clk &= 0x3FFFFFFF;
-    cout << "Setting RF5C68 clock to " << dec << rf5c68_clk << " Hz" << endl;
+    BEEVGM_LOG(LogInfo, "Setting RF5C68 clock to " << dec << rf5c68_clk << " Hz");
     rf5c68_chip.init(rf5c68_clk);
 }
 
 void BeeVGM::init_multipcm()
 {
-    cout << "Sega MultiPCM detected" << endl;
+    BEEVGM_LOG(LogInfo, "Sega MultiPCM detected");
     uint32_t multipcm_clk = readLong(0x88);
     uint32_t clk_masked = (multipcm_clk & 0x3FFFFFFF);
-    cout << "Setting MultiPCM clock to " << dec << clk_masked << " Hz" << endl;
+    BEEVGM_LOG(LogInfo, "Setting MultiPCM clock to " << dec << clk_masked << " Hz");
     multipcm_chips.init(multipcm_clk);
 }
 
@@ -394,13 +785,13 @@ bool BeeVGM::is_at_least(uint8_t major, uint8_t minor)
     uint8_t ver_minor = toBCD(minor);
 
     uint16_t ver_number = ((ver_major << 8) | ver_minor);
-    return (vgm_version >= ver_number);
+    return (vgm_loader.get_version() >= ver_number);
 }
 
 string BeeVGM::fetch_version_str(bool is_wip)
 {
-    uint8_t ver_major = (vgm_version >> 8);
-    uint8_t ver_minor = (vgm_version & 0xFF);
+    uint8_t ver_major = (vgm_loader.get_version() >> 8);
+    uint8_t ver_minor = (vgm_loader.get_version() & 0xFF);
     stringstream verstr;
     verstr << "VGM v" << hex << (int)ver_major << "." << hex << setw(2) << setfill('0') << (int)ver_minor;
 
@@ -422,11 +813,6 @@ uint16_t BeeVGM::readWord(uint32_t addr)
     return (readByte((addr + 1)) << 8) | (readByte(addr));
 }
 
-uint32_t BeeVGM::readHLong(uint32_t addr)
-{
-    return (readByte((addr + 2)) << 16) | (readWord(addr));
-}
-
 uint32_t BeeVGM::readLong(uint32_t addr)
 {
     return (readWord((addr + 2)) << 16) | (readWord(addr));
@@ -434,574 +820,543 @@ uint32_t BeeVGM::readLong(uint32_t addr)
 
 uint32_t BeeVGM::readLongHeader(uint32_t addr)
 {
-    return (fetch_start() >= addr) ? readLong(addr) : 0;
+    return (vgm_loader.get_data_offset() >= (addr + 4)) ? readLong(addr) : 0;
 }
 
-uint8_t BeeVGM::getimmByte()
+BeeVGMError BeeVGM::getError()
 {
-    return readByte(vgm_pos++);
+    return vgm_loader.get_error();
 }
 
-uint16_t BeeVGM::getimmWord()
+string BeeVGM::getErrorString()
 {
-    uint16_t value = readWord(vgm_pos);
-    vgm_pos += 2;
-    return value;
+    return vgm_loader.get_error_string();
 }
 
-uint32_t BeeVGM::getimmHLong()
-{
-    uint32_t value = readHLong(vgm_pos);
-    vgm_pos += 3;
-    return value;
-}
-
-uint32_t BeeVGM::getimmLong()
+bool BeeVGM::isEndofStream()
 {
-    uint32_t value = readLong(vgm_pos);
-    vgm_pos += 4;
-    return value;
+    return end_of_stream;
 }
 
-uint32_t BeeVGM::fetch_start()
+uint32_t BeeVGM::decodeFrame()
 {
-    if (is_at_least(1, 50))
-    {
-	return (0x34 + readLong(0x34));
-    }
-    else
+    if (end_of_stream)
     {
-	return 0x40;
+	return 0;
     }
-}
 
-void BeeVGM::unrecognized_instr(uint8_t vgm_instr)
-{
-    cout << "Unrecognized VGM instruction of " << hex << (int)vgm_instr << endl;
-    exit(1);
-}
+    const BeeVGMCommandStream &commands = vgm_loader.get_commands();
 
-bool BeeVGM::isEndofStream()
-{
-    return end_of_stream;
-}
+    // Commands are compiled as the file is decompressed
+    while ((cmd_pos >= commands.size()) && loadMoreData())
+    {
+	continue;
+    }
 
-uint32_t BeeVGM::decodeFrame()
-{
-    if (end_of_stream)
+    if (cmd_pos >= commands.size())
     {
+	end_of_stream = true;
 	return 0;
     }
 
+    return executeCommand(commands.at(cmd_pos++));
+}
+
+uint32_t BeeVGM::executeCommand(const BeeVGMCommand &cmd)
+{
+    const BeeVGMCommandStream &commands = vgm_loader.get_commands();
     uint32_t num_samples = 0;
-    uint8_t vgm_instr = getimmByte();
 
-    switch (vgm_instr)
+    switch (cmd.type)
     {
-	// Game Gear port 0x06 write
-	case 0x4F:
+	case CmdWrite: writeChip(cmd); break;
+	case CmdMemWrite:
 	{
-	    uint8_t data = getimmByte();
-	    snpsg_chip.writeIO(1, data);
+	    switch (cmd.chip)
+	    {
+		// Sega PCM RAM write
+		case ChipSegaPCM: segapcm_chip.writeMem(cmd.reg, cmd.value); break;
+		// RF5C68 RAM write
+		case ChipRF5C68: rf5c68_chip.writeMem(cmd.reg, cmd.value); break;
+		default: break;
+	    }
 	}
 	break;
-	// SN76489 write
-	case 0x50:
+	// MultiPCM bank offset set
+	case CmdBankWrite:
 	{
-	    uint8_t data = getimmByte();
-	    snpsg_chip.writeIO(0, data);
+	    multipcm_chips.getChip(cmd.instance).writeBank(cmd.reg, cmd.value);
 	}
 	break;
-	// YM2413 write
-	case 0x51:
+	case CmdWait: num_samples = cmd.wait; break;
+	// Write to YM2612 chip 0 DAC, then wait n samples
+	case CmdDACWrite:
 	{
 	    if (is_ymfm_auto)
 	    {
-		init_ym2413();
+		init_ym2612();
+	    }
+
+	    auto &chip = opn2_chips.getChip(false);
+
+	    if (chip.isChipEnabled())
+	    {
+		uint8_t data = 0x80;
+
+		const auto &ym2612_dac = pcm_banks[0x00];
+
+		if (ym2612_dac.is_valid(pcm_pos))
+		{
+		    data = ym2612_dac.read(pcm_pos++);
+		}
+
+		chip.writeYM(0, 0x2A, data);
 	    }
 
-	    uint8_t addr = getimmByte();
-	    uint8_t data = getimmByte();
-	    
-	    opll_chip.writeYM(addr, data);
+	    num_samples = cmd.wait;
 	}
 	break;
-	// YM2612 chip 0, port 0 write
-	case 0x52:
+	// PCM offset
+	case CmdPCMSeek: pcm_pos = cmd.data; break;
+	case CmdDataBlock: writeDataBlock(cmd.data); break;
+	case CmdRAMWrite: writePCMRAM(commands.get_ram_transfer(cmd.data)); break;
+	// DAC stream control
+	case CmdStreamSetup:
+	case CmdStreamData:
+	case CmdStreamFreq:
+	case CmdStreamStop:
+	case CmdStreamStartFast: dac_streams.command(cmd); break;
+	case CmdStreamStart: dac_streams.start(cmd.instance, commands.get_stream_start(cmd.data)); break;
+	case CmdUnknown:
+	case CmdEnd:
+	{
+	    vgm_loader.check_end((cmd_pos - 1));
+	    end_of_stream = true;
+	}
+	break;
+	default: break;
+    }
+
+    return num_samples;
+}
+
+void BeeVGM::writeChip(const BeeVGMCommand &cmd)
+{
+    switch (cmd.chip)
+    {
+	case ChipSN76489: snpsg_chip.writeIO(cmd.port, cmd.value); break;
+	case ChipYM2413:
 	{
 	    if (is_ymfm_auto)
 	    {
-		init_ym2612();
+		init_ym2413();
 	    }
 
-	    uint8_t addr = getimmByte();
-	    uint8_t data = getimmByte();
-
-	    opn2_chips.writeYM(false, 0, addr, data);
+	    opll_chip.writeYM(cmd.reg, cmd.value);
 	}
 	break;
-	// YM2612 chip 0, port 1 write
-	case 0x53:
+	case ChipYM2612:
 	{
-	    if (is_ymfm_auto)
+	    if (is_ymfm_auto && (cmd.instance == 0))
 	    {
 		init_ym2612();
 	    }
 
-	    uint8_t addr = getimmByte();
-	    uint8_t data = getimmByte();
-
-	    opn2_chips.writeYM(false, 1, addr, data);
+	    opn2_chips.writeYM(cmd.instance, cmd.port, cmd.reg, cmd.value);
 	}
 	break;
-	// YM2151 write
-	case 0x54:
+	case ChipYM2151:
 	{
 	    if (is_ymfm_auto)
 	    {
 		init_ym2151();
 	    }
 
-	    uint8_t addr = getimmByte();
-	    uint8_t data = getimmByte();
-	    
-	    opm_chip.writeYM(addr, data);
+	    opm_chip.writeYM(cmd.reg, cmd.value);
 	}
 	break;
-	// YM2203 write
-	case 0x55:
+	case ChipYM2203: opn_chip.writeYM(cmd.reg, cmd.value); break;
+	case ChipYM2610: opnb_chip.writeYM(cmd.port, cmd.reg, cmd.value); break;
+	case ChipYM3812: opl2_chip.writeYM(cmd.reg, cmd.value); break;
+	case ChipYM3526: opl_chip.writeYM(cmd.reg, cmd.value); break;
+	case ChipY8950: opl_msx_chip.writeYM(cmd.reg, cmd.value); break;
+	case ChipYMZ280B: ymz280b_chip.writeYM(cmd.reg, cmd.value); break;
+	case ChipYMF262: opl3_chip.writeYM(cmd.port, cmd.reg, cmd.value); break;
+	case ChipRF5C68: rf5c68_chip.writeReg(cmd.reg, cmd.value); break;
+	case ChipMultiPCM: multipcm_chips.writeIO(cmd.instance, cmd.reg, cmd.value); break;
+	// Chips that aren't emulated yet (these are written to constantly, so they're only traced)
+	case ChipPWM:
 	{
-	    uint8_t addr = getimmByte();
-	    uint8_t data = getimmByte();
-
-	    opn_chip.writeYM(addr, data);
+	    BEEVGM_LOG(LogDebug, "Writing value of " << hex << int(cmd.value) << " to PWM register of " << dec << int(cmd.reg));
 	}
 	break;
-	// YM2610 port 0 write
-	case 0x58:
+	case ChipYMF278B:
+	case ChipYMF271:
 	{
-	    uint8_t addr = getimmByte();
-	    uint8_t data = getimmByte();
-
-	    opnb_chip.writeYM(0, addr, data);
+	    BEEVGM_LOG(LogDebug, "Writing value of " << hex << int(cmd.value) << " to " << ((cmd.instance != 0) ? "second" : "first") << " " << ((cmd.chip == ChipYMF278B) ? "YMF278B" : "YMF271") << " port " << dec << int(cmd.port) << " register of " << hex << int(cmd.reg));
 	}
 	break;
-	// YM2610 port 1 write
-	case 0x59:
-	{
-	    uint8_t addr = getimmByte();
-	    uint8_t data = getimmByte();
-
-	    opnb_chip.writeYM(1, addr, data);
-	}
-	break;
-	// YM3812 write
-	case 0x5A:
-	{
-	    uint8_t addr = getimmByte();
-	    uint8_t data = getimmByte();
-
-	    opl2_chip.writeYM(addr, data);
-	}
-	break;
-	// YM3526 write
-	case 0x5B:
-	{
-	    uint8_t addr = getimmByte();
-	    uint8_t data = getimmByte();
+	default: break;
+    }
+}
 
-	    opl_chip.writeYM(addr, data);
-	}
-	break;
-	// Y8950 write
-	case 0x5C:
-	{
-	    uint8_t addr = getimmByte();
-	    uint8_t data = getimmByte();
+void BeeVGM::writeDataBlock(uint32_t block_index)
+{
+    const BeeVGMDataBlock &block = vgm_loader.get_commands().get_data_block(block_index);
 
-	    opl_msx_chip.writeYM(addr, data);
-	}
-	break;
-	// YMZ280B write
-	case 0x5D:
-	{
-	    uint8_t addr = getimmByte();
-	    uint8_t data = getimmByte();
+    uint8_t data_type = block.data_type;
+    uint32_t data_size = block.size;
+    uint32_t data_pos = block.offset;
+    uint8_t data_group = (data_type & 0xC0);
+    bool is_second_chip = block.is_second_chip;
 
-	    ymz280b_chip.writeYM(addr, data);
-	}
-	break;
-	// YMF262 port 0 write
-	case 0x5E:
+    switch (data_group)
+    {
+	// Data streams (see loadPCMBlocks below)
+	case 0x00:
+	case 0x40: loadPCMBlocks((block_index + 1)); break;
+	// ROM/RAM image dumps
+	case 0x80:
 	{
-	    uint8_t addr = getimmByte();
-	    uint8_t data = getimmByte();
+	    uint32_t rom_size = readLong(data_pos);
+	    uint32_t data_start = readLong((data_pos + 4));
+	    uint32_t data_len = (data_size - 8);
+	    uint32_t vgm_data_pos = (data_pos + 8);
 
-	    opl3_chip.writeYM(0, addr, data);
-	}
-	break;
-	// YMF262 port 1 write
-	case 0x5F:
-	{
-	    uint8_t addr = getimmByte();
-	    uint8_t data = getimmByte();
+	    auto begin = (vgm_data.data() + vgm_data_pos);
+	    auto end = (begin + data_len);
+	    vector<uint8_t> rom_data(begin, end);
 
-	    opl3_chip.writeYM(1, addr, data);
-	}
-	break;
-	// Wait nn samples
-	case 0x61:
-	{
-	    num_samples = getimmWord();
-	}
-	break;
-	// Wait 735 samples
-	case 0x62:
-	{
-	    num_samples = 735;
-	}
-	break;
-	// Wait 882 samples
-	case 0x63:
-	{
-	    num_samples = 882;
-	}
-	break;
-	// End of stream
-	case 0x66:
-	{
-	    end_of_stream = true;
+	    switch (data_type)
+	    {
+		// SegaPCM ROM data
+		case 0x80: segapcm_chip.writeROM(rom_size, data_start, data_len, move(rom_data)); break;
+		// YM2610 ADPCM ROM data
+		case 0x82: opnb_chip.writeROM(0, rom_size, data_start, data_len, move(rom_data)); break;
+		// YM2610 Delta-T ROM data
+		case 0x83: opnb_chip.writeROM(1, rom_size, data_start, data_len, move(rom_data)); break;
+		// YMZ280B ROM data
+		case 0x86: ymz280b_chip.writeROM(rom_size, data_start, data_len, move(rom_data)); break;
+		// Y8950 Delta-T ROM data
+		case 0x88: opl_msx_chip.writeROM(rom_size, data_start, data_len, move(rom_data)); break;
+		// MultiPCM ROM data
+		case 0x89: multipcm_chips.getChip(is_second_chip).writeROM(rom_size, data_start, data_len, move(rom_data)); break;
+		default: BEEVGM_LOG(LogWarning, "Skipping unrecognized PCM ROM type of " << hex << (int)data_type); break;
+	    }
 	}
 	break;
-	// Data block
-	case 0x67:
+	// RAM writes
+	case 0xC0:
 	{
-	    vgm_pos += 1;
-	    uint8_t data_type = getimmByte();
-	    uint32_t data_size = getimmLong();
-	    uint8_t chip_type = (data_type & 0x3F);
-	    uint8_t data_group = (data_type & 0xC0);
+	    uint32_t data_start = readWord(data_pos);
+	    uint32_t data_len = (data_size - 2);
+	    uint32_t vgm_data_pos = (data_pos + 2);
 
-	    bool is_second_chip = ((data_size >> 31) != 0);
+	    auto begin = (vgm_data.data() + vgm_data_pos);
+	    auto end = (begin + data_len);
 
-	    data_size &= 0x7FFFFFFF;
+	    vector<uint8_t> ram_data(begin, end);
 
-	    switch (data_group)
+	    switch (data_type)
 	    {
-		// Uncompressed data streams
-		case 0x00:
-		{
-		    vector<uint8_t> chip_data = pcm_data.at(chip_type);
-		    uint32_t old_size = chip_data.size();
-		    chip_data.resize((old_size + data_size));
-		    auto begin = (vgm_data.begin() + vgm_pos);
-		    auto end = (begin + data_size);
-		    copy(begin, end, (chip_data.begin() + old_size));
-		    pcm_data.at(chip_type) = chip_data;
-		}
-		break;
-		// Compressed data streams (WIP)
-		case 0x40:
-		{
-		    uint8_t comp_type = readByte(vgm_pos);
-		    uint32_t uncomp_size = readLong(vgm_pos + 1);
-
-		    cout << "Reading compression header with compression type of " << hex << int(comp_type) << endl;
-		}
-		break;
-		// ROM/RAM image dumps
-		case 0x80:
-		{
-		    uint32_t rom_size = readLong(vgm_pos);
-		    uint32_t data_start = readLong((vgm_pos + 4));
-		    uint32_t data_len = (data_size - 8);
-		    uint32_t vgm_data_pos = (vgm_pos + 8);
-
-		    auto begin = (vgm_data.begin() + vgm_data_pos);
-		    auto end = (begin + data_len);
-		    vector<uint8_t> rom_data(begin, end);
-
-		    switch (data_type)
-		    {
-			// SegaPCM ROM data
-			case 0x80: segapcm_chip.writeROM(rom_size, data_start, data_len, rom_data); break;
-			// YM2610 ADPCM ROM data
-			case 0x82: opnb_chip.writeROM(0, rom_size, data_start, data_len, rom_data); break;
-			// YM2610 Delta-T ROM data
-			case 0x83: opnb_chip.writeROM(1, rom_size, data_start, data_len, rom_data); break;
-			// YMZ280B ROM data
-			case 0x86: ymz280b_chip.writeROM(rom_size, data_start, data_len, rom_data); break;
-			// Y8950 Delta-T ROM data
-			case 0x88: opl_msx_chip.writeROM(rom_size, data_start, data_len, rom_data); break;
-			// MultiPCM ROM data
-			case 0x89: multipcm_chips.getChip(is_second_chip).writeROM(rom_size, data_start, data_len, rom_data); break;
-			default: cout << "Skipping unrecognized PCM ROM type of " << hex << (int)data_type << endl; break;
-		    }
-		}
-		break;
-		// RAM writes
 		case 0xC0:
 		{
-		    uint32_t data_start = readWord(vgm_pos);
-		    uint32_t data_len = (data_size - 2);
-		    uint32_t vgm_data_pos = (vgm_pos + 2);
-
-		    auto begin = (vgm_data.begin() + vgm_data_pos);
-		    auto end = (begin + data_len);
-
-		    vector<uint8_t> ram_data(begin, end);
-
-		    
-
-		    switch (data_type)
-		    {
-			case 0xC0:
-			{
-			    rf5c68_chip.writeRAM(data_start, data_len, ram_data);
-			}
-			break;
-			default: cout << "Skipping unrecognized RAM data type of " << hex << int(data_type) << endl;
-		    }
+		    rf5c68_chip.writeRAM(data_start, data_len, move(ram_data));
 		}
 		break;
-		default: cout << "Skipping unrecognized data type of " << hex << int(data_type) << endl; break;
+		default: BEEVGM_LOG(LogWarning, "Skipping unrecognized RAM data type of " << hex << int(data_type));
 	    }
-
-	    vgm_pos += data_size;
 	}
 	break;
-	// PCM RAM write
-	case 0x68:
-	{
-	    vgm_pos += 1;
-
-	    uint8_t chip_type = getimmByte();
-	    uint32_t read_offs = getimmHLong();
-	    uint32_t write_offs = getimmHLong();
-	    uint32_t data_size = getimmHLong();
-
-	    chip_type &= 0x3F;
+	default: BEEVGM_LOG(LogWarning, "Skipping unrecognized data type of " << hex << int(data_type)); break;
+    }
+}
 
-	    if (data_size == 0)
-	    {
-		data_size = 0x1000000;
-	    }
+// Loads any data stream blocks (types 0x00-0x7F) among the first 'num_blocks'
+// data blocks that haven't been loaded yet
+//
+// Stream data only ever needs to be loaded (and decompressed) once, since
+// the banks stick around when the song loops
+void BeeVGM::loadPCMBlocks(uint32_t num_blocks)
+{
+    for (uint32_t block_index = pcm_blocks_loaded; block_index < num_blocks; block_index++)
+    {
+	const BeeVGMDataBlock &block = vgm_loader.get_commands().get_data_block(block_index);
+	pcm_banks.add_stream_block(block.data_type, vgm_data.subspan(block.offset, block.size));
+    }
 
-	    auto &ram_data = pcm_data.at(chip_type);
+    pcm_blocks_loaded = max(pcm_blocks_loaded, num_blocks);
+}
 
-	    if (read_offs >= ram_data.size())
-	    {
-		break;
-	    }
+void BeeVGM::writePCMRAM(const BeeVGMRAMTransfer &transfer)
+{
+    uint8_t chip_type = transfer.chip_type;
+    uint32_t read_offs = transfer.read_offs;
+    uint32_t write_offs = transfer.write_offs;
+    uint32_t data_size = transfer.size;
 
-	    uint32_t data_length = data_size;
-	    uint32_t data_end = (read_offs + data_size);
+    const auto &ram_data = pcm_banks[chip_type];
 
-	    if (data_end > ram_data.size())
-	    {
-		cout << "Overflow" << endl;
-		data_length = (ram_data.size() - read_offs);
-	    }
+    if (!ram_data.is_valid(read_offs))
+    {
+	return;
+    }
 
-	    auto begin = (ram_data.begin() + read_offs);
-	    auto end = (begin + data_length);
+    BeeVGMSpan ram_span = ram_data.read_span(read_offs, data_size);
+    uint32_t data_length = ram_span.size();
 
-	    vector<uint8_t> pcm_ram(begin, end);
+    if (data_length < data_size)
+    {
+	BEEVGM_LOG(LogWarning, "PCM RAM write overflows the data bank");
+    }
 
-	    switch (chip_type)
-	    {
-		case 0x01:
-		{
-		    rf5c68_chip.writeRAM(write_offs, data_length, pcm_ram);
-		}
-		break;
-		default: cout << "Skipping unrecognized PCM RAM write data type of " << hex << int(chip_type) << endl; break;
-	    }
+    vector<uint8_t> pcm_ram(ram_span.data(), (ram_span.data() + data_length));
 
-	    pcm_ram.clear();
-	}
-	break;
-	// YM2612 chip 1, port 0 write
-	case 0xA2:
+    switch (chip_type)
+    {
+	case 0x01:
 	{
-	    uint8_t addr = getimmByte();
-	    uint8_t data = getimmByte();
-
-	    opn2_chips.writeYM(true, 0, addr, data);
+	    rf5c68_chip.writeRAM(write_offs, data_length, move(pcm_ram));
 	}
 	break;
-	// YM2612 chip 1, port 1 write
-	case 0xA3:
-	{
-	    uint8_t addr = getimmByte();
-	    uint8_t data = getimmByte();
+	default: BEEVGM_LOG(LogWarning, "Skipping unrecognized PCM RAM write data type of " << hex << int(chip_type)); break;
+    }
+}
 
-	    opn2_chips.writeYM(true, 1, addr, data);
-	}
-	break;
-	// RF5C68 register write
-	case 0xB0:
-	{
-	    uint8_t addr = getimmByte();
-	    uint8_t data = getimmByte();
+array<int16_t, 2> BeeVGM::generateSample()
+{
+    dac_streams.advance();
 
-	    rf5c68_chip.writeReg(addr, data);
-	}
-	break;
-	// PWM register write
-	case 0xB2:
-	{
-	    uint8_t addr_byte = getimmByte();
-	    uint8_t data_byte = getimmByte();
+    array<int32_t, 2> samples = {0, 0};
 
-	    int reg = (addr_byte >> 4);
-	    uint16_t data = (((addr_byte & 0xF) << 8) | data_byte);
+    snpsg_chip.add_samples(samples);
+    opll_chip.add_samples(samples);
+    opn2_chips.add_samples(samples);
+    opm_chip.add_samples(samples);
 
-	    cout << "Writing value of " << hex << int(data) << " to PWM register of " << dec << int(reg) << endl;
-	}
-	break;
-	// MultiPCM register write
-	case 0xB5:
-	{
-	    uint8_t addr = getimmByte();
-	    uint8_t data = getimmByte();
+    segapcm_chip.add_samples(samples);
+    opn_chip.add_samples(samples);
+    opnb_chip.add_samples(samples);
+    opl2_chip.add_samples(samples);
+    opl_chip.add_samples(samples);
+    // opl_msx_chip.add_samples(samples);
+    ymz280b_chip.add_samples(samples);
+    rf5c68_chip.add_samples(samples);
 
-	    bool is_second_chip = ((addr >> 7) != 0);
+    multipcm_chips.add_samples(samples);
 
-	    addr &= 0x7F;
-	    multipcm_chips.writeIO(is_second_chip, addr, data);
-	}
-	break;
-	// Sega PCM RAM write
-	case 0xC0:
-	{
-	    uint16_t addr = getimmWord();
-	    uint8_t data = getimmByte();
+    // Saturate once, after everything's been mixed together
+    array<int16_t, 2> final_samples = {0, 0};
+    final_samples[0] = clamp<int32_t>(samples[0], -32768, 32767);
+    final_samples[1] = clamp<int32_t>(samples[1], -32768, 32767);
 
-	    segapcm_chip.writeMem(addr, data);
-	}
-	break;
-	// RF5C68 RAM write
-	case 0xC1:
+    sample_pos += 1;
+    return final_samples;
+}
+
+// Renders up to 'frames' interleaved stereo frames into 'out', decoding
+// commands as needed, and returns the number of frames written
+// (which is less than 'frames' only once the end of the stream is reached)
+//
+// This is meant to be used in place of decodeFrame() and generateSample(),
+// rather than alongside them
+size_t BeeVGM::render(int16_t *out, size_t frames)
+{
+    size_t frames_done = 0;
+
+    while (frames_done < frames)
+    {
+	if (pending_samples == 0)
 	{
-	    uint16_t addr = getimmWord();
-	    uint8_t data = getimmByte();
+	    if (end_of_stream)
+	    {
+		is_index_done = true;
+		break;
+	    }
 
-	    rf5c68_chip.writeMem(addr, data);
+	    pending_samples = decodeFrame();
+	    continue;
 	}
-	break;
-	// MultiPCM bank offset set
-	case 0xC3:
+
+	size_t num_frames = min<size_t>({pending_samples, (frames - frames_done), max_block_frames});
+
+	// Stops at each keyframe while the seek index is being built
+	if (!keyframes.empty() && !is_index_done)
 	{
-	    uint8_t channel = getimmByte();
-	    uint16_t bank_offs = getimmWord();
+	    uint64_t next_keyframe_pos = (keyframes.back().sample_pos + keyframe_interval);
 
-	    bool is_second_chip = ((channel >> 7) != 0);
+	    if (sample_pos >= next_keyframe_pos)
+	    {
+		keyframes.emplace_back();
+		saveKeyframe(keyframes.back());
+		next_keyframe_pos = (sample_pos + keyframe_interval);
+	    }
 
-	    channel &= 0x7F;
-	    multipcm_chips.getChip(is_second_chip).writeBank(channel, bank_offs);
+	    num_frames = size_t(min<uint64_t>(num_frames, (next_keyframe_pos - sample_pos)));
 	}
-	break;
-	// YMF278B register write
-	case 0xD0:
-	{
-	    uint8_t port = getimmByte();
-	    uint8_t addr = getimmByte();
-	    uint8_t data = getimmByte();
 
-	    bool is_second_chip = ((port >> 7) != 0);
+	render_block(&out[(frames_done * 2)], num_frames);
+	pending_samples -= num_frames;
+	frames_done += num_frames;
+	sample_pos += num_frames;
+    }
 
-	    string chip_str = (is_second_chip) ? "second" : "first";
+    return frames_done;
+}
 
-	    port &= 0x7F;
+// Running DAC streams write to their chips between output samples,
+// so the block gets split up at every sample that has writes due
+void BeeVGM::render_block(int16_t *out, size_t num_frames)
+{
+    if (!dac_streams.is_active())
+    {
+	render_chips(out, num_frames, sample_pos);
+	return;
+    }
 
-	    cout << "Writing value of " << hex << int(data) << " to " << chip_str << " YMF278B port " << dec << int(port) << " register of " << hex << int(addr) << endl;
-	}
-	break;
-	// YMF271 register write
-	case 0xD1:
-	{
-	    uint8_t port = getimmByte();
-	    uint8_t addr = getimmByte();
-	    uint8_t data = getimmByte();
+    size_t frames_done = 0;
 
-	    bool is_second_chip = ((port >> 7) != 0);
+    while (frames_done < num_frames)
+    {
+	dac_streams.advance();
 
-	    string chip_str = (is_second_chip) ? "second" : "first";
+	size_t run_frames = dac_streams.samples_until_write((num_frames - frames_done));
+	render_chips(&out[(frames_done * 2)], run_frames, (sample_pos + frames_done));
+	dac_streams.advance((run_frames - 1));
+	frames_done += run_frames;
+    }
+}
 
-	    port &= 0x7F;
+void BeeVGM::setRenderThreads(size_t num_threads)
+{
+    if (num_threads == 0)
+    {
+	num_threads = BeeVGMThreadPool::default_threads();
+    }
 
-	    cout << "Writing value of " << hex << int(data) << " to " << chip_str << " YMF271 port " << dec << int(port) << " register of " << hex << int(addr) << endl;
-	}
-	break;
-	// PCM offset
-	case 0xE0: pcm_pos = getimmLong(); break;
-	default:
-	{
-	    int vgm_nibble = (vgm_instr & 0xF);
-	    switch ((vgm_instr & 0xF0))
-	    {
-		// Wait n+1 samples
-		case 0x70: num_samples = (vgm_nibble + 1); break;
-		// Write to YM2612 chip 0 DAC, then wait n samples
-		case 0x80:
-		{
-		    if (is_ymfm_auto)
-		    {
-			init_ym2612();
-		    }
+    // The calling thread renders too, so it's one less worker than that
+    render_pool.reset();
 
-		    auto &chip = opn2_chips.getChip(false);
+    if (num_threads > 1)
+    {
+	render_pool = make_unique<BeeVGMThreadPool>((num_threads - 1));
+    }
+}
 
-		    if (chip.isChipEnabled())
-		    {
-			uint8_t data = 0x80;
+// Between two writes, every chip runs on its own, so they can all be rendered at once
+// (into their own buffers), and then mixed together once they're all done
+void BeeVGM::render_chips_parallel(size_t num_frames)
+{
+    render_jobs.clear();
+
+    add_render_job(snpsg_chip, num_frames);
+    add_render_job(opll_chip, num_frames);
+    add_render_job(opn2_chips[0], num_frames);
+    add_render_job(opn2_chips[1], num_frames);
+    add_render_job(opm_chip, num_frames);
+
+    add_render_job(segapcm_chip, num_frames);
+    add_render_job(opn_chip, num_frames);
+    add_render_job(opnb_chip, num_frames);
+    add_render_job(opl2_chip, num_frames);
+    add_render_job(opl_chip, num_frames);
+    add_render_job(ymz280b_chip, num_frames);
+    add_render_job(rf5c68_chip, num_frames);
+
+    add_render_job(multipcm_chips[0], num_frames);
+    add_render_job(multipcm_chips[1], num_frames);
+
+    // The calling thread takes the first chip itself, and idle workers steal the rest
+    for (size_t index = 1; index < render_jobs.size(); index++)
+    {
+	auto &job = render_jobs[index];
+	render_pool->submit([&job](size_t) {
+	    job();
+	});
+    }
 
-			auto ym2612_dac = pcm_data.at(0x00);
+    if (!render_jobs.empty())
+    {
+	render_jobs[0]();
+    }
 
-			if (pcm_pos < ym2612_dac.size())
-			{
-			    data = ym2612_dac.at(pcm_pos++);
-			}
+    render_pool->wait();
 
-			chip.writeYM(0, 0x2A, data);
-		    }
+    snpsg_chip.mix(mixer, num_frames);
+    opll_chip.mix(mixer, num_frames);
+    opn2_chips[0].mix(mixer, num_frames);
+    opn2_chips[1].mix(mixer, num_frames);
+    opm_chip.mix(mixer, num_frames);
 
-		    num_samples = vgm_nibble;
-		}
-		break;
-		default: unrecognized_instr(vgm_instr); break;
-	    }
-	}
-	break;
-    }
+    segapcm_chip.mix(mixer, num_frames);
+    opn_chip.mix(mixer, num_frames);
+    opnb_chip.mix(mixer, num_frames);
+    opl2_chip.mix(mixer, num_frames);
+    opl_chip.mix(mixer, num_frames);
+    ymz280b_chip.mix(mixer, num_frames);
+    rf5c68_chip.mix(mixer, num_frames);
 
-    return num_samples;
+    multipcm_chips[0].mix(mixer, num_frames);
+    multipcm_chips[1].mix(mixer, num_frames);
 }
 
-array<int16_t, 2> BeeVGM::generateSample()
+void BeeVGM::render_chips(int16_t *out, size_t num_frames, uint64_t frame_pos)
 {
-    array<int32_t, 2> samples = {0, 0};
+    mixer.clear(num_frames);
 
-    snpsg_chip.add_samples(samples);
-    opll_chip.add_samples(samples);
-    opn2_chips.add_samples(samples);
-    opm_chip.add_samples(samples);
+    if ((render_pool != nullptr) && (num_frames >= min_parallel_frames))
+    {
+	render_chips_parallel(num_frames);
+	tap_chips(frame_pos, num_frames);
+	mixer.output(out, num_frames);
+	return;
+    }
 
-    segapcm_chip.add_samples(samples);
-    opn_chip.add_samples(samples);
-    opnb_chip.add_samples(samples);
-    opl2_chip.add_samples(samples);
-    opl_chip.add_samples(samples);
-    // opl_msx_chip.add_samples(samples);
-    ymz280b_chip.add_samples(samples);
-    rf5c68_chip.add_samples(samples);
+    snpsg_chip.add_samples(mixer, num_frames);
+    opll_chip.add_samples(mixer, num_frames);
+    opn2_chips.add_samples(mixer, num_frames);
+    opm_chip.add_samples(mixer, num_frames);
 
-    multipcm_chips.add_samples(samples);
+    segapcm_chip.add_samples(mixer, num_frames);
+    opn_chip.add_samples(mixer, num_frames);
+    opnb_chip.add_samples(mixer, num_frames);
+    opl2_chip.add_samples(mixer, num_frames);
+    opl_chip.add_samples(mixer, num_frames);
+    // opl_msx_chip.add_samples(mixer, num_frames);
+    ymz280b_chip.add_samples(mixer, num_frames);
+    rf5c68_chip.add_samples(mixer, num_frames);
 
-    array<int16_t, 2> final_samples = {0, 0};
-    final_samples[0] = clamp<int16_t>(samples[0], -32768, 32767);
-    final_samples[1] = clamp<int16_t>(samples[1], -32768, 32767);
+    multipcm_chips.add_samples(mixer, num_frames);
 
-    return final_samples;
+    tap_chips(frame_pos, num_frames);
+    mixer.output(out, num_frames);
+}
+
+void BeeVGM::setChipTap(BeeVGMChipTap tap)
+{
+    chip_tap = tap;
+}
+
+// Every chip that was mixed into the last block (in the same order)
+void BeeVGM::tap_chips(uint64_t frame_pos, size_t num_frames)
+{
+    if (!chip_tap)
+    {
+	return;
+    }
+
+    snpsg_chip.tap(chip_tap, ChipSN76489, 0, frame_pos, num_frames);
+    opll_chip.tap(chip_tap, ChipYM2413, 0, frame_pos, num_frames);
+    opn2_chips.tap(chip_tap, ChipYM2612, frame_pos, num_frames);
+    opm_chip.tap(chip_tap, ChipYM2151, 0, frame_pos, num_frames);
+
+    segapcm_chip.tap(chip_tap, ChipSegaPCM, 0, frame_pos, num_frames);
+    opn_chip.tap(chip_tap, ChipYM2203, 0, frame_pos, num_frames);
+    opnb_chip.tap(chip_tap, ChipYM2610, 0, frame_pos, num_frames);
+    opl2_chip.tap(chip_tap, ChipYM3812, 0, frame_pos, num_frames);
+    opl_chip.tap(chip_tap, ChipYM3526, 0, frame_pos, num_frames);
+    ymz280b_chip.tap(chip_tap, ChipYMZ280B, 0, frame_pos, num_frames);
+    rf5c68_chip.tap(chip_tap, ChipRF5C68, 0, frame_pos, num_frames);
+
+    multipcm_chips.tap(chip_tap, ChipMultiPCM, frame_pos, num_frames);
 }
\ No newline at end of file
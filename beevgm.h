@@ -34,7 +34,18 @@
 #include <vector>
 #include <array>
 #include <functional>
+#include <memory>
 #include <bitset>
+#include "beevgm_log.h"
+#include "beevgm_mixer.h"
+#include "beevgm_command.h"
+#include "beevgm_file.h"
+#include "beevgm_loader.h"
+#include "beevgm_pcm.h"
+#include "beevgm_stream.h"
+#include "beevgm_event.h"
+#include "beevgm_pool.h"
+#include <utfcpp/utf8.h>
 #include <cores/sn76489.h>
 #include <cores/ym2413.h>
 #include <cores/ym2612.h>
@@ -55,6 +66,27 @@ namespace beevgm
 {
     typedef vector<uint16_t> BeeGD3_Vec;
 
+    enum BeeGD3Field
+    {
+	GD3TrackNameEN = 0,
+	GD3TrackNameJP,
+	GD3GameNameEN,
+	GD3GameNameJP,
+	GD3SysNameEN,
+	GD3SysNameJP,
+	GD3TrackAuthorEN,
+	GD3TrackAuthorJP,
+	GD3GameReleaseDate,
+	GD3NameOfConverter,
+	GD3Notes,
+	GD3NumFields
+    };
+
+    // Lazy view of a GD3 tag inside the loaded VGM data
+    //
+    // open() only locates the strings; each one is decoded the first time
+    // it's asked for and cached from then on. The view refers to the VGM
+    // data it was opened on, so it's only valid for as long as that data is
     class BeeGD3
     {
 	public:
@@ -63,7 +95,19 @@ namespace beevgm
 
 	    }
 
-	    bool open(vector<uint8_t> memory, size_t gd3_pos)
+	    // Opens the GD3 tag pointed to by the VGM header in 'memory'
+	    bool open(const BeeVGMSpan &memory)
+	    {
+		if (memory.size() < 0x18)
+		{
+		    return false;
+		}
+
+		uint32_t gd3_offs = readLong(memory, 0x14);
+		return open(memory, (gd3_offs != 0) ? (0x14 + gd3_offs) : 0);
+	    }
+
+	    bool open(const BeeVGMSpan &memory, size_t gd3_pos)
 	    {
 		if (is_parsed)
 		{
@@ -72,7 +116,7 @@ namespace beevgm
 
 		is_parsed = true;
 
-		if (gd3_pos == 0)
+		if ((gd3_pos == 0) || ((gd3_pos + 12) > memory.size()))
 		{
 		    return false;
 		}
@@ -94,7 +138,7 @@ namespace beevgm
 
 		if (!is_gd3_id_match)
 		{
-		    cout << "GD3 ID mismatch" << endl;
+		    BEEVGM_LOG(LogWarning, "GD3 ID mismatch");
 		    return false;
 		}
 
@@ -102,133 +146,202 @@ namespace beevgm
 
 		if (gd3_ver != 0x100)
 		{
-		    cout << "GD3 version mismatch" << endl;
+		    BEEVGM_LOG(LogWarning, "GD3 version mismatch");
 		    return false;
 		}
 
-		tag_offset = (gd3_pos + 12);
+		uint32_t gd3_len = readLong(memory, (gd3_pos + 8));
+		size_t tag_offset = (gd3_pos + 12);
+		size_t tag_end = min<size_t>((tag_offset + gd3_len), memory.size());
+
+		tag_data = memory.subspan(tag_offset, (tag_end - tag_offset));
 		is_gd3_found = true;
 
-		createGD3Vec(memory, track_name_en);
-		createGD3Vec(memory, track_name_jp);
-		createGD3Vec(memory, game_name_en);
-		createGD3Vec(memory, game_name_jp);
-		createGD3Vec(memory, sys_name_en);
-		createGD3Vec(memory, sys_name_jp);
-		createGD3Vec(memory, track_author_en);
-		createGD3Vec(memory, track_author_jp);
-		createGD3Vec(memory, game_release_date);
-		createGD3Vec(memory, name_of_converter);
-		createGD3Vec(memory, notes);
+		size_t char_offset = 0;
+
+		for (auto &field : fields)
+		{
+		    field.offset = char_offset;
+
+		    while ((char_offset + 2) <= tag_data.size())
+		    {
+			uint16_t track_char = readWord(tag_data, char_offset);
+			char_offset += 2;
+
+			if (track_char == 0)
+			{
+			    break;
+			}
+
+			field.length += 1;
+		    }
+		}
+
 		return true;
 	    }
 
-	    bool is_found()
+	    void close()
+	    {
+		is_gd3_found = false;
+		is_parsed = false;
+		tag_data = BeeVGMSpan();
+		fields.fill(BeeGD3String());
+	    }
+
+	    bool is_found() const
 	    {
 		return is_gd3_found;
 	    }
 
-	    BeeGD3_Vec get_track_name_en()
+	    // Returns the UTF-16 code units of a field, including its terminating zero
+	    const BeeGD3_Vec &get_utf16(BeeGD3Field field) const
+	    {
+		auto &gd3_str = fields.at(field);
+
+		if (!gd3_str.is_utf16_cached)
+		{
+		    gd3_str.utf16.reserve((gd3_str.length + 1));
+
+		    for (size_t i = 0; i < gd3_str.length; i++)
+		    {
+			gd3_str.utf16.push_back(readWord(tag_data, (gd3_str.offset + (i * 2))));
+		    }
+
+		    gd3_str.utf16.push_back(0);
+		    gd3_str.is_utf16_cached = true;
+		}
+
+		return gd3_str.utf16;
+	    }
+
+	    // Returns a field converted to UTF-8 (without a terminating zero)
+	    const string &get_utf8(BeeGD3Field field) const
 	    {
-		return track_name_en;
+		auto &gd3_str = fields.at(field);
+
+		if (!gd3_str.is_utf8_cached)
+		{
+		    const BeeGD3_Vec &utf16_str = get_utf16(field);
+		    auto utf16_end = (utf16_str.end() - 1);
+
+		    try
+		    {
+			utf8::utf16to8(utf16_str.begin(), utf16_end, back_inserter(gd3_str.utf8));
+		    }
+		    catch (utf8::exception &ex)
+		    {
+			// Stray surrogates and the like shouldn't make the whole tag unreadable
+			gd3_str.utf8.clear();
+			utf8::unchecked::utf16to8(utf16_str.begin(), utf16_end, back_inserter(gd3_str.utf8));
+		    }
+
+		    gd3_str.is_utf8_cached = true;
+		}
+
+		return gd3_str.utf8;
 	    }
 
-	    BeeGD3_Vec get_track_name_jp()
+	    const BeeGD3_Vec &get_track_name_en() const
 	    {
-		return track_name_jp;
+		return get_utf16(GD3TrackNameEN);
 	    }
 
-	    BeeGD3_Vec get_game_name_en()
+	    const BeeGD3_Vec &get_track_name_jp() const
 	    {
-		return game_name_en;
+		return get_utf16(GD3TrackNameJP);
 	    }
 
-	    BeeGD3_Vec get_game_name_jp()
+	    const BeeGD3_Vec &get_game_name_en() const
 	    {
-		return game_name_jp;
+		return get_utf16(GD3GameNameEN);
 	    }
 
-	    BeeGD3_Vec get_sys_name_en()
+	    const BeeGD3_Vec &get_game_name_jp() const
 	    {
-		return sys_name_en;
+		return get_utf16(GD3GameNameJP);
 	    }
 
-	    BeeGD3_Vec get_sys_name_jp()
+	    const BeeGD3_Vec &get_sys_name_en() const
 	    {
-		return sys_name_jp;
+		return get_utf16(GD3SysNameEN);
 	    }
 
-	    BeeGD3_Vec get_track_author_en()
+	    const BeeGD3_Vec &get_sys_name_jp() const
 	    {
-		return track_author_en;
+		return get_utf16(GD3SysNameJP);
 	    }
 
-	    BeeGD3_Vec get_track_author_jp()
+	    const BeeGD3_Vec &get_track_author_en() const
 	    {
-		return track_author_jp;
+		return get_utf16(GD3TrackAuthorEN);
 	    }
 
-	    BeeGD3_Vec get_game_release_date()
+	    const BeeGD3_Vec &get_track_author_jp() const
 	    {
-		return game_release_date;
+		return get_utf16(GD3TrackAuthorJP);
 	    }
 
-	    BeeGD3_Vec get_name_of_converter()
+	    const BeeGD3_Vec &get_game_release_date() const
 	    {
-		return name_of_converter;
+		return get_utf16(GD3GameReleaseDate);
 	    }
 
-	    BeeGD3_Vec get_notes()
+	    const BeeGD3_Vec &get_name_of_converter() const
 	    {
-		return notes;
+		return get_utf16(GD3NameOfConverter);
+	    }
+
+	    const BeeGD3_Vec &get_notes() const
+	    {
+		return get_utf16(GD3Notes);
 	    }
 
 	private:
+	    struct BeeGD3String
+	    {
+		size_t offset = 0;
+		size_t length = 0;
+		bool is_utf16_cached = false;
+		bool is_utf8_cached = false;
+		BeeGD3_Vec utf16;
+		string utf8;
+	    };
+
 	    bool is_gd3_found = false;
 	    bool is_parsed = false;
 
-	    BeeGD3_Vec track_name_en;
-	    BeeGD3_Vec track_name_jp;
-	    BeeGD3_Vec game_name_en;
-	    BeeGD3_Vec game_name_jp;
-	    BeeGD3_Vec sys_name_en;
-	    BeeGD3_Vec sys_name_jp;
-	    BeeGD3_Vec track_author_en;
-	    BeeGD3_Vec track_author_jp;
-	    BeeGD3_Vec game_release_date;
-	    BeeGD3_Vec name_of_converter;
-	    BeeGD3_Vec notes;
+	    BeeVGMSpan tag_data;
+	    mutable array<BeeGD3String, GD3NumFields> fields;
 
-	    uint8_t readByte(vector<uint8_t> memory, uint32_t addr)
+	    static uint8_t readByte(const BeeVGMSpan &memory, size_t addr)
 	    {
 		return memory.at(addr);
 	    }
 
-	    uint16_t readWord(vector<uint8_t> memory, uint32_t addr)
+	    static uint16_t readWord(const BeeVGMSpan &memory, size_t addr)
 	    {
 		return (readByte(memory, (addr + 1)) << 8) | (readByte(memory, addr));
 	    }
 
-	    uint32_t readLong(vector<uint8_t> memory, uint32_t addr)
+	    static uint32_t readLong(const BeeVGMSpan &memory, size_t addr)
 	    {
 		return (readWord(memory, (addr + 2)) << 16) | (readWord(memory, addr));
 	    }
-
-	    void createGD3Vec(vector<uint8_t> memory, BeeGD3_Vec &vec)
-	    {
-		uint16_t track_char = 0;
-
-		do
-		{
-		    track_char = readWord(memory, tag_offset);
-		    tag_offset += 2;
-		    vec.push_back(track_char);
-		} while (track_char != 0);
-	    }
-
-	    uint32_t tag_offset = 0;
     };
 
+    // Receives one chip's output for a block of 'num_frames' frames, starting
+    // 'frame_pos' frames from the start of playback (see BeeVGM::setChipTap)
+    using BeeVGMChipTap = function<void(BeeVGMChipID chip_id, int instance, uint64_t frame_pos, const int32_t *left, const int32_t *right, size_t num_frames)>;
+
+    // T is one of the BeeVGM_* chip wrappers in cores/, which provide
+    // clock() and get_sample() for a single chip sample, and
+    // clock_block(left, right, n) for a run of 'n' chip samples
+    //
+    // The wrapper (and the core inside it, with all its ROM and RAM) is
+    // only created once init() is called for a chip the file actually uses,
+    // so an engine only pays for the chips in the file it's playing.
+    // reset() just disables the chip, so that the next init() can rebuild
+    // the wrapper in the memory it already has
     template<class T>
     class BeeVGMChip
     {
@@ -245,21 +358,42 @@ namespace beevgm
 
 	    void init(uint32_t clockrate, uint32_t samplerate = 44100)
 	    {
+		if (chip == nullptr)
+		{
+		    chip = make_unique<T>();
+		}
+		else
+		{
+		    // Back to power-on, without reallocating (if T() throws,
+		    // the old chip is left as it was)
+		    *chip = T();
+		}
+
 		clock_rate = (clockrate & 0x3FFFFFFF);
-		out_step = chip.get_sample_rate(clock_rate);
+		out_step = chip->get_sample_rate(clock_rate);
 		in_step = samplerate;
 		out_time = 0.0f;
+		last_sample = chip->get_sample();
 		is_enabled = true;
 	    }
 
+	    void reset()
+	    {
+		is_enabled = false;
+		is_output = true;
+		out_time = 0.0f;
+		last_sample = {0, 0};
+	    }
+
 	    bool isChipEnabled()
 	    {
 		return is_enabled;
 	    }
 
+	    // (chips that haven't been created yet stay disabled)
 	    void setEnable(bool enable_val)
 	    {
-		is_enabled = enable_val;
+		is_enabled = (enable_val && (chip != nullptr));
 	    }
 
 	    void enableOutput(bool enable_val)
@@ -269,7 +403,12 @@ namespace beevgm
 
 	    void config(uint32_t flags)
 	    {
-		chip.save_config(flags);
+		if (!isChipEnabled())
+		{
+		    return;
+		}
+
+		chip->save_config(flags);
 	    }
 
 	    void writeYM(uint8_t reg, uint8_t data)
@@ -291,7 +430,7 @@ namespace beevgm
 		    return;
 		}
 
-		chip.writeIO(port, val);
+		chip->writeIO(port, val);
 	    }
 
 	    void writeROM(size_t rom_size, size_t data_start, size_t data_len, vector<uint8_t> rom_data)
@@ -301,7 +440,7 @@ namespace beevgm
 		    return;
 		}
 
-		writeROM(0, rom_size, data_start, data_len, rom_data);
+		writeROM(0, rom_size, data_start, data_len, move(rom_data));
 	    }
 
 	    void writeROM(int type, size_t rom_size, size_t data_start, size_t data_len, vector<uint8_t> rom_data)
@@ -311,7 +450,7 @@ namespace beevgm
 		    return;
 		}
 
-		chip.writeROM(type, rom_size, data_start, data_len, rom_data);
+		chip->writeROM(type, rom_size, data_start, data_len, move(rom_data));
 	    }
 
 	    void writeRAM(int data_start, int data_len, vector<uint8_t> ram_data)
@@ -321,7 +460,7 @@ namespace beevgm
 		    return;
 		}
 
-		chip.writeRAM(data_start, data_len, ram_data);
+		chip->writeRAM(data_start, data_len, move(ram_data));
 	    }
 
 	    void writeBank(uint8_t channel, uint16_t bank_offs)
@@ -331,9 +470,9 @@ namespace beevgm
 		    return;
 		}
 
-		chip.writeIO(3, channel);
-		chip.writeIO(4, (bank_offs >> 8));
-		chip.writeIO(5, (bank_offs & 0xFF));
+		chip->writeIO(3, channel);
+		chip->writeIO(4, (bank_offs >> 8));
+		chip->writeIO(5, (bank_offs & 0xFF));
 	    }
 
 	    void writeMem(uint16_t addr, uint8_t data)
@@ -343,9 +482,9 @@ namespace beevgm
 		    return;
 		}
 
-		chip.writeIO(0, (addr >> 8));
-		chip.writeIO(1, (addr & 0xFF));
-		chip.writeIO(2, data);
+		chip->writeIO(0, (addr >> 8));
+		chip->writeIO(1, (addr & 0xFF));
+		chip->writeIO(2, data);
 	    }
 
 	    void writeReg(uint8_t reg, uint8_t data)
@@ -355,8 +494,8 @@ namespace beevgm
 		    return;
 		}
 
-		chip.writeIO(3, reg);
-		chip.writeIO(4, data);
+		chip->writeIO(3, reg);
+		chip->writeIO(4, data);
 	    }
 
 	    void add_samples(array<int32_t, 2> &old_samples)
@@ -369,12 +508,109 @@ namespace beevgm
 		auto new_samples = chipclock();
 		for (int i = 0; i < 2; i++)
 		{
-		    old_samples[i] = mix_sample(old_samples[i], new_samples[i]);
+		    old_samples[i] += new_samples[i];
+		}
+	    }
+
+	    // Renders a run of samples and adds them to the mixer's accumulators
+	    void add_samples(BeeVGMMixer &mixer, size_t num_frames)
+	    {
+		render(num_frames);
+		mix(mixer, num_frames);
+	    }
+
+	    // The two halves of the above, for rendering chips in parallel
+	    // (render() only touches this chip, so chips can render on different threads)
+	    bool isActive()
+	    {
+		return (isChipEnabled() && is_output);
+	    }
+
+	    void render(size_t num_frames)
+	    {
+		if (!isActive())
+		{
+		    return;
+		}
+
+		chipclock(num_frames);
+	    }
+
+	    void mix(BeeVGMMixer &mixer, size_t num_frames)
+	    {
+		if (!isActive())
+		{
+		    return;
+		}
+
+		mixer.add(out_left.data(), out_right.data(), num_frames);
+	    }
+
+	    // Hands the samples from the last render() over to 'chip_tap'
+	    void tap(const BeeVGMChipTap &chip_tap, BeeVGMChipID chip_id, int instance, uint64_t frame_pos, size_t num_frames)
+	    {
+		if (!isActive())
+		{
+		    return;
+		}
+
+		chip_tap(chip_id, instance, frame_pos, out_left.data(), out_right.data(), num_frames);
+	    }
+
+	    // Everything but the render buffers, as saved in a seek keyframe
+	    // (the chip itself is saved by copying the whole wrapper, if it's enabled,
+	    // and that copy is never changed again, so copies of a snapshot share it
+	    // along with any ROM in it)
+	    struct Snapshot
+	    {
+		shared_ptr<const T> chip;
+		float out_step = 0.0f;
+		float in_step = 0.0f;
+		float out_time = 0.0f;
+		bool is_enabled = false;
+		bool is_output = true;
+		uint32_t clock_rate = 0;
+		array<int32_t, 2> last_sample = {0, 0};
+	    };
+
+	    void save_snapshot(Snapshot &snapshot) const
+	    {
+		snapshot.chip = is_enabled ? make_shared<const T>(*chip) : nullptr;
+		snapshot.out_step = out_step;
+		snapshot.in_step = in_step;
+		snapshot.out_time = out_time;
+		snapshot.is_enabled = is_enabled;
+		snapshot.is_output = is_output;
+		snapshot.clock_rate = clock_rate;
+		snapshot.last_sample = last_sample;
+	    }
+
+	    void load_snapshot(const Snapshot &snapshot)
+	    {
+		// Chips that weren't enabled are left as they are (and disabled below)
+		if (snapshot.chip != nullptr)
+		{
+		    if (chip == nullptr)
+		    {
+			chip = make_unique<T>(*snapshot.chip);
+		    }
+		    else
+		    {
+			*chip = *snapshot.chip;
+		    }
 		}
+
+		out_step = snapshot.out_step;
+		in_step = snapshot.in_step;
+		out_time = snapshot.out_time;
+		is_enabled = snapshot.is_enabled;
+		is_output = snapshot.is_output;
+		clock_rate = snapshot.clock_rate;
+		last_sample = snapshot.last_sample;
 	    }
 
 	private:
-	    T chip;
+	    unique_ptr<T> chip;
 
 	    float out_step = 0.0f;
 	    float in_step = 0.0f;
@@ -384,27 +620,85 @@ namespace beevgm
 
 	    uint32_t clock_rate = 0;
 
+	    array<int32_t, 2> last_sample = {0, 0};
+
+	    // Native chip output for the current block...
+	    vector<int32_t> chip_left;
+	    vector<int32_t> chip_right;
+	    // ...the number of chip samples clocked by the end of each output sample...
+	    vector<size_t> clock_counts;
+	    // ...and the resampled output
+	    vector<int32_t> out_left;
+	    vector<int32_t> out_right;
+
 	    array<int32_t, 2> chipclock()
 	    {
 		while (out_step > out_time)
 		{
-		    chip.clock();
+		    chip->clock();
 		    out_time += in_step;
 		}
 
 		out_time -= out_step;
 
-		array<int32_t, 2> sample = chip.get_sample();
-		return sample;
+		last_sample = chip->get_sample();
+		return last_sample;
 	    }
 
-	    int32_t mix_sample(int32_t old_sample, int32_t new_sample)
+	    // Block counterpart of the above: clocks the chip in one go for
+	    // 'num_frames' output samples, then picks out the chip sample
+	    // that's current at the end of each output sample
+	    void chipclock(size_t num_frames)
 	    {
-		int32_t sample1 = int32_t(old_sample);
-		int32_t sample2 = clamp<int32_t>(new_sample, -32768, 32767);
+		if (clock_counts.size() < num_frames)
+		{
+		    clock_counts.resize(num_frames);
+		    out_left.resize(num_frames);
+		    out_right.resize(num_frames);
+		}
+
+		size_t num_clocks = 0;
+
+		for (size_t i = 0; i < num_frames; i++)
+		{
+		    while (out_step > out_time)
+		    {
+			num_clocks += 1;
+			out_time += in_step;
+		    }
+
+		    out_time -= out_step;
+		    clock_counts[i] = num_clocks;
+		}
+
+		if (chip_left.size() < num_clocks)
+		{
+		    chip_left.resize(num_clocks);
+		    chip_right.resize(num_clocks);
+		}
 
-		int32_t result = (sample1 + sample2);
-		return clamp<int32_t>(result, -32768, 32767);
+		chip->clock_block(chip_left.data(), chip_right.data(), num_clocks);
+
+		for (size_t i = 0; i < num_frames; i++)
+		{
+		    size_t count = clock_counts[i];
+
+		    if (count == 0)
+		    {
+			out_left[i] = last_sample[0];
+			out_right[i] = last_sample[1];
+		    }
+		    else
+		    {
+			out_left[i] = chip_left[(count - 1)];
+			out_right[i] = chip_right[(count - 1)];
+		    }
+		}
+
+		if (num_clocks != 0)
+		{
+		    last_sample = {chip_left[(num_clocks - 1)], chip_right[(num_clocks - 1)]};
+		}
 	    }
     };
 
@@ -431,11 +725,19 @@ namespace beevgm
 
 		if (is_dual_chip)
 		{
-		    cout << "Dual chips detected" << endl;
+		    BEEVGM_LOG(LogInfo, "Dual chips detected");
 		    sound_chips[1].init(clock_rate);
 		}
 	    }
 
+	    void reset()
+	    {
+		for (auto &chip : sound_chips)
+		{
+		    chip.reset();
+		}
+	    }
+
 	    void writeYM(bool is_chip2, uint8_t reg, uint8_t data)
 	    {
 		writeYM(is_chip2, 0, reg, data);
@@ -480,6 +782,40 @@ namespace beevgm
 		}
 	    }
 
+	    void add_samples(BeeVGMMixer &mixer, size_t num_frames)
+	    {
+		for (auto &chip : sound_chips)
+		{
+		    chip.add_samples(mixer, num_frames);
+		}
+	    }
+
+	    void tap(const BeeVGMChipTap &chip_tap, BeeVGMChipID chip_id, uint64_t frame_pos, size_t num_frames)
+	    {
+		for (int index = 0; index < 2; index++)
+		{
+		    sound_chips[index].tap(chip_tap, chip_id, index, frame_pos, num_frames);
+		}
+	    }
+
+	    using Snapshot = array<typename T::Snapshot, 2>;
+
+	    void save_snapshot(Snapshot &snapshot) const
+	    {
+		for (int index = 0; index < 2; index++)
+		{
+		    sound_chips[index].save_snapshot(snapshot[index]);
+		}
+	    }
+
+	    void load_snapshot(const Snapshot &snapshot)
+	    {
+		for (int index = 0; index < 2; index++)
+		{
+		    sound_chips[index].load_snapshot(snapshot[index]);
+		}
+	    }
+
 	private:
 	    array<T, 2> sound_chips;
     };
@@ -502,6 +838,83 @@ namespace beevgm
     using MultiPCMType = BeeVGMChip<BeeVGM_MultiPCM>;
     using MultiPCM = BeeVGMDualChip<MultiPCMType>;
 
+    // Engine state at some point in playback, as saved by the seek index
+    struct BeeVGMKeyframe
+    {
+	uint64_t sample_pos = 0;
+	size_t cmd_pos = 0;
+	uint32_t pending_samples = 0;
+	bool end_of_stream = false;
+	bool is_ymfm_auto = false;
+
+	uint32_t pcm_pos = 0;
+	uint32_t pcm_blocks_loaded = 0;
+	BeeVGMPCMMark pcm_mark;
+	vector<BeeVGMDACStream> dac_streams;
+
+	SNPSG::Snapshot snpsg_chip;
+	OPLL::Snapshot opll_chip;
+	OPN2::Snapshot opn2_chips;
+	OPM::Snapshot opm_chip;
+	OPN::Snapshot opn_chip;
+	OPNB::Snapshot opnb_chip;
+	OPL::Snapshot opl_chip;
+	OPL_MSX::Snapshot opl_msx_chip;
+	OPL2::Snapshot opl2_chip;
+	OPL3::Snapshot opl3_chip;
+	SegaPCM::Snapshot segapcm_chip;
+	YMZ280B::Snapshot ymz280b_chip;
+	RF5C68::Snapshot rf5c68_chip;
+	MultiPCM::Snapshot multipcm_chips;
+    };
+
+    // Track lengths, as worked out by BeeVGM::scan()
+    struct BeeVGMScanInfo
+    {
+	// Lengths in samples (at 44100 Hz)...
+	uint64_t total_samples = 0;
+	uint64_t loop_samples = 0;
+	// ...and in milliseconds
+	uint64_t total_ms = 0;
+	uint64_t loop_ms = 0;
+	bool is_looped = false;
+
+	// Lengths given in the header (at 0x18 and 0x20), and whether they agree with the above
+	uint32_t header_total_samples = 0;
+	uint32_t header_loop_samples = 0;
+	bool is_header_match = false;
+    };
+
+    // A saved copy of an engine's whole state (see BeeVGM::saveState)
+    //
+    // Copies share the same (read-only) saved state, so one state can be
+    // loaded into any number of engines at once, from any thread
+    class BeeVGMState
+    {
+	public:
+	    BeeVGMState()
+	    {
+
+	    }
+
+	    bool is_valid() const
+	    {
+		return (keyframe != nullptr);
+	    }
+
+	    // Number of samples played when the state was saved
+	    uint64_t get_position() const
+	    {
+		return is_valid() ? keyframe->sample_pos : 0;
+	    }
+
+	private:
+	    friend class BeeVGM;
+
+	    shared_ptr<const BeeVGMKeyframe> keyframe;
+	    uint64_t file_id = 0;
+    };
+
     class BeeVGM
     {
 	public:
@@ -509,18 +922,71 @@ namespace beevgm
 	    ~BeeVGM();
 
 	    bool load(vector<uint8_t> memory);
+	    bool load(const uint8_t *data, size_t size);
+	    bool loadFile(string filename);
+	    // Unloads the file, keeping the chips and buffers around to be reused by the
+	    // next file (loading a file does this first, so an engine can play any number of files)
+	    void reset();
+	    // Starts the loaded file over from the beginning, with every chip back at power-on
+	    // (the commands, PCM data and seek index are all kept, so it's cheap)
+	    bool reload();
 	    uint32_t decodeFrame();
 	    array<int16_t, 2> generateSample();
+	    size_t render(int16_t *out, size_t frames);
 	    bool isEndofStream();
 	    uint32_t getLoopOffset();
 	    void seekLoop(uint32_t offset);
-	    BeeGD3 getGD3Tag();
+	    const BeeGD3 &getGD3Tag();
+	    // Whether a compressed file has been completely decompressed yet
+	    bool isLoadComplete();
+
+	    // Default spacing of seek keyframes (5 seconds)
+	    static constexpr uint32_t default_keyframe_interval = (44100 * 5);
+
+	    // Starts saving a keyframe every 'interval' samples as the file is rendered,
+	    // until it first ends or loops (has to be called before anything's been played)
+	    bool enableSeekIndex(uint32_t interval = default_keyframe_interval);
+	    // Renders the file through once (without looping) to build the whole index up front
+	    bool buildSeekIndex(uint32_t interval = default_keyframe_interval);
+	    // Moves playback to 'sample_index' samples from the start
+	    bool seek(uint64_t sample_index);
+	    // Number of samples played since the start (including any loops)
+	    uint64_t getPosition();
+
+	    // Renders each chip on a thread of its own (up to 'num_threads' at once, counting
+	    // the calling thread, or one per hardware thread if 'num_threads' is 0), which
+	    // pays off for files with several heavy chips. 1 (the default) goes back to
+	    // rendering every chip on the calling thread
+	    void setRenderThreads(size_t num_threads);
+
+	    // Has 'chip_tap' called with each chip's own output (before it's mixed in)
+	    // for every block that render() mixes, for checking the chips one at a
+	    // time, e.g. against known-good output (an empty function turns it off,
+	    // and so does reset(), i.e. loading another file)
+	    void setChipTap(BeeVGMChipTap tap);
+
+	    // Works out the track's length from its commands alone (without
+	    // emulating anything), leaving playback where it is
+	    BeeVGMScanInfo scan();
+
+	    // Saves the engine's whole state, which can be loaded back into
+	    // this engine, or into any other engine with the same file loaded
+	    BeeVGMState saveState();
+	    bool loadState(const BeeVGMState &state);
+
+	    // First problem found since the file was loaded (ErrorNone if there wasn't one),
+	    // along with a description of it
+	    //
+	    // None of these are fatal: a file that fails to load can just be
+	    // replaced with another, and one that stops early plays up to that point
+	    BeeVGMError getError();
+	    string getErrorString();
 
 	private:
 	    bool parseheader();
+	    bool loadMoreData();
+	    void reset_playback();
 
-	    void unrecognized_instr(uint8_t vgm_instr);
-	    uint32_t fetch_start();
 	    bool is_at_least(uint8_t major, uint8_t minor);
 	    string fetch_version_str(bool is_wip);
 	    void detect_standard_features();
@@ -528,22 +994,25 @@ namespace beevgm
 	    void detect_v151_features();
 	    void detect_v161_features();
 
-	    vector<uint8_t> vgm_data;
-	    uint32_t vgm_pos = 0;
-	    uint32_t vgm_version = 0;
-	    uint32_t vgm_loop_offset = 0;
+	    BeeVGMLoader vgm_loader;
+	    BeeVGMSpan vgm_data;
+	    // Hash of the header, to check that saved states are for the same file
+	    uint64_t file_id = 0;
+	    uint64_t fetch_file_id();
 	    bool end_of_stream = false;
 
 	    uint8_t readByte(uint32_t addr);
 	    uint16_t readWord(uint32_t addr);
-	    uint32_t readHLong(uint32_t addr);
 	    uint32_t readLong(uint32_t addr);
 	    uint32_t readLongHeader(uint32_t addr);
 
-	    uint8_t getimmByte();
-	    uint16_t getimmWord();
-	    uint32_t getimmHLong();
-	    uint32_t getimmLong();
+	    size_t cmd_pos = 0;
+
+	    uint32_t executeCommand(const BeeVGMCommand &cmd);
+	    void writeChip(const BeeVGMCommand &cmd);
+	    void writeDataBlock(uint32_t block_index);
+	    void loadPCMBlocks(uint32_t num_blocks);
+	    void writePCMRAM(const BeeVGMRAMTransfer &transfer);
 
 	    void init_sn76489();
 	    void init_ym2413();
@@ -563,6 +1032,46 @@ namespace beevgm
 	    void init_multipcm();
 
 	    uint32_t pcm_pos = 0;
+	    // Number of data blocks already loaded, so looping doesn't load them again
+	    uint32_t pcm_blocks_loaded = 0;
+
+	    // Largest run of samples mixed in one go by render()
+	    static constexpr size_t max_block_frames = 2048;
+
+	    uint32_t pending_samples = 0;
+	    BeeVGMMixer mixer;
+	    void render_block(int16_t *out, size_t num_frames);
+	    void render_chips(int16_t *out, size_t num_frames, uint64_t frame_pos);
+
+	    // Blocks shorter than this aren't worth handing out to other threads
+	    static constexpr size_t min_parallel_frames = 64;
+
+	    unique_ptr<BeeVGMThreadPool> render_pool;
+	    vector<function<void()>> render_jobs;
+	    void render_chips_parallel(size_t num_frames);
+
+	    BeeVGMChipTap chip_tap;
+	    void tap_chips(uint64_t frame_pos, size_t num_frames);
+
+	    template<class T>
+	    void add_render_job(T &chip, size_t num_frames)
+	    {
+		if (chip.isActive())
+		{
+		    render_jobs.push_back([&chip, num_frames]() {
+			chip.render(num_frames);
+		    });
+		}
+	    }
+
+	    uint64_t sample_pos = 0;
+	    uint32_t keyframe_interval = default_keyframe_interval;
+	    vector<BeeVGMKeyframe> keyframes;
+	    // Set once playback first ends or loops, after which no more keyframes are saved
+	    bool is_index_done = false;
+	    void saveKeyframe(BeeVGMKeyframe &keyframe);
+	    void loadKeyframe(const BeeVGMKeyframe &keyframe);
+	    uint64_t skipSamples(uint64_t num_samples);
 
 	    bool is_ymfm_auto = false;
 
@@ -581,11 +1090,10 @@ namespace beevgm
 	    RF5C68 rf5c68_chip;
 	    MultiPCM multipcm_chips;
 
-	    array<vector<uint8_t>, 0x40> pcm_data;
+	    BeeVGMPCMBanks pcm_banks;
+	    BeeVGMDACStreams dac_streams;
 
 	    BeeGD3 vgm_tag;
-
-	    uint32_t gd3_pos = 0;
 	    void parseGD3();
     };
 };
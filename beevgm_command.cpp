@@ -0,0 +1,630 @@
+/*
+    This file is part of the BeeVGM engine.
+    Copyright (C) 2022 BueniaDev.
+
+    BeeVGM is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    BeeVGM is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with BeeVGM.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include "beevgm_command.h"
+#include "beevgm_log.h"
+using namespace beevgm;
+using namespace std;
+
+BeeVGMCommandStream::BeeVGMCommandStream()
+{
+
+}
+
+BeeVGMCommandStream::~BeeVGMCommandStream()
+{
+
+}
+
+void BeeVGMCommandStream::clear()
+{
+    commands.clear();
+    command_offsets.clear();
+    data_blocks.clear();
+    ram_transfers.clear();
+    stream_starts.clear();
+    compile_pos = 0;
+    is_compiled = false;
+    is_cut_short = false;
+    num_invalid_blocks = 0;
+    skipped_commands.reset();
+}
+
+uint32_t BeeVGMCommandStream::get_command_length(uint8_t vgm_instr)
+{
+    switch (vgm_instr)
+    {
+	// Game Gear stereo
+	case 0x4F:
+	case 0x50: return 2;
+	// Wait nn samples
+	case 0x61: return 3;
+	// Wait 735/882 samples, end of stream
+	case 0x62:
+	case 0x63:
+	case 0x66: return 1;
+	// Data block (its length comes from its header)
+	case 0x67: return 0;
+	// PCM RAM write
+	case 0x68: return 12;
+	// DAC stream control
+	case 0x90: return 5;
+	case 0x91: return 5;
+	case 0x92: return 6;
+	case 0x93: return 11;
+	case 0x94: return 2;
+	case 0x95: return 5;
+	default: break;
+    }
+
+    switch ((vgm_instr & 0xF0))
+    {
+	// Second SN76489 writes (0x30, 0x3F), then reserved with one operand byte
+	case 0x30: return 2;
+	// Reserved with two operand bytes (0x40-0x4E, as 0x4F is handled above)
+	case 0x40: return 3;
+	// Register writes
+	case 0x50: return 3;
+	// Short waits, and YM2612 DAC writes
+	case 0x70:
+	case 0x80: return 1;
+	// AY8910, second chip writes and reserved (0xA0-0xAF),
+	// then writes to chips with 8-bit registers (0xB0-0xBF)
+	case 0xA0:
+	case 0xB0: return 3;
+	// Chips with 16-bit addresses (0xC0-0xC8, 0xD0-0xD6), reserved for the rest
+	case 0xC0:
+	case 0xD0: return 4;
+	// PCM offset, C352 writes (0xE1), then reserved with four operand bytes
+	case 0xE0:
+	case 0xF0: return 5;
+	// Everything else (0x00-0x2F, 0x60, 0x64, 0x65, 0x69-0x6F and 0x96-0x9F) isn't defined
+	default: return 0;
+    }
+}
+
+size_t BeeVGMCommandStream::find_offset(uint32_t offset) const
+{
+    auto iter = lower_bound(command_offsets.begin(), command_offsets.end(), offset);
+    return (iter - command_offsets.begin());
+}
+
+void BeeVGMCommandStream::add_command(uint32_t offset, const BeeVGMCommand &cmd)
+{
+    commands.push_back(cmd);
+    command_offsets.push_back(offset);
+}
+
+void BeeVGMCommandStream::add_write(uint32_t offset, BeeVGMChipID chip, uint8_t instance, uint8_t port, uint16_t reg, uint16_t value)
+{
+    BeeVGMCommand cmd;
+    cmd.type = CmdWrite;
+    cmd.chip = chip;
+    cmd.instance = instance;
+    cmd.port = port;
+    cmd.reg = reg;
+    cmd.value = value;
+    add_command(offset, cmd);
+}
+
+void BeeVGMCommandStream::add_wait(uint32_t offset, uint32_t num_samples)
+{
+    BeeVGMCommand cmd;
+    cmd.type = CmdWait;
+    cmd.wait = num_samples;
+    add_command(offset, cmd);
+}
+
+void BeeVGMCommandStream::compile(const uint8_t *data, size_t size, uint32_t start_pos)
+{
+    begin(start_pos);
+    compile_more(data, size, true);
+}
+
+void BeeVGMCommandStream::begin(uint32_t start_pos)
+{
+    clear();
+    compile_pos = start_pos;
+}
+
+void BeeVGMCommandStream::compile_more(const uint8_t *data, size_t size, bool is_final)
+{
+    if (is_compiled)
+    {
+	return;
+    }
+
+    size_t pos = compile_pos;
+
+    auto has_bytes = [&](size_t num_bytes) -> bool {
+	return ((pos + num_bytes) <= size);
+    };
+
+    auto readByte = [&](size_t addr) -> uint8_t {
+	return data[addr];
+    };
+
+    auto readWord = [&](size_t addr) -> uint16_t {
+	return (readByte((addr + 1)) << 8) | readByte(addr);
+    };
+
+    auto readHLong = [&](size_t addr) -> uint32_t {
+	return (readByte((addr + 2)) << 16) | readWord(addr);
+    };
+
+    auto readLong = [&](size_t addr) -> uint32_t {
+	return (readWord((addr + 2)) << 16) | readWord(addr);
+    };
+
+    bool is_end = false;
+
+    while (!is_end)
+    {
+	uint32_t offset = pos;
+
+	if (!has_bytes(1))
+	{
+	    if (!is_final)
+	    {
+		compile_pos = offset;
+		return;
+	    }
+
+	    break;
+	}
+
+	uint8_t vgm_instr = readByte(pos);
+
+	// Write commands of the form 'cc aa dd'
+	auto add_reg_write = [&](BeeVGMChipID chip, uint8_t instance, uint8_t port) -> bool {
+	    if (!has_bytes(3))
+	    {
+		return false;
+	    }
+
+	    add_write(offset, chip, instance, port, readByte((pos + 1)), readByte((pos + 2)));
+	    pos += 3;
+	    return true;
+	};
+
+	bool is_valid = true;
+
+	switch (vgm_instr)
+	{
+	    // Game Gear port 0x06 write
+	    case 0x4F:
+	    case 0x50:
+	    {
+		if (!has_bytes(2))
+		{
+		    is_valid = false;
+		    break;
+		}
+
+		uint8_t port = (vgm_instr == 0x4F) ? 1 : 0;
+		add_write(offset, ChipSN76489, 0, port, 0, readByte((pos + 1)));
+		pos += 2;
+	    }
+	    break;
+	    case 0x51: is_valid = add_reg_write(ChipYM2413, 0, 0); break;
+	    case 0x52: is_valid = add_reg_write(ChipYM2612, 0, 0); break;
+	    case 0x53: is_valid = add_reg_write(ChipYM2612, 0, 1); break;
+	    case 0x54: is_valid = add_reg_write(ChipYM2151, 0, 0); break;
+	    case 0x55: is_valid = add_reg_write(ChipYM2203, 0, 0); break;
+	    case 0x58: is_valid = add_reg_write(ChipYM2610, 0, 0); break;
+	    case 0x59: is_valid = add_reg_write(ChipYM2610, 0, 1); break;
+	    case 0x5A: is_valid = add_reg_write(ChipYM3812, 0, 0); break;
+	    case 0x5B: is_valid = add_reg_write(ChipYM3526, 0, 0); break;
+	    case 0x5C: is_valid = add_reg_write(ChipY8950, 0, 0); break;
+	    case 0x5D: is_valid = add_reg_write(ChipYMZ280B, 0, 0); break;
+	    case 0x5E: is_valid = add_reg_write(ChipYMF262, 0, 0); break;
+	    case 0x5F: is_valid = add_reg_write(ChipYMF262, 0, 1); break;
+	    // Wait nn samples
+	    case 0x61:
+	    {
+		if (!has_bytes(3))
+		{
+		    is_valid = false;
+		    break;
+		}
+
+		add_wait(offset, readWord((pos + 1)));
+		pos += 3;
+	    }
+	    break;
+	    // Wait 735 samples
+	    case 0x62: add_wait(offset, 735); pos += 1; break;
+	    // Wait 882 samples
+	    case 0x63: add_wait(offset, 882); pos += 1; break;
+	    // End of stream
+	    case 0x66: is_end = true; break;
+	    // Data block
+	    case 0x67:
+	    {
+		if (!has_bytes(7))
+		{
+		    is_valid = false;
+		    break;
+		}
+
+		uint32_t data_size = readLong((pos + 3));
+
+		BeeVGMDataBlock block;
+		block.data_type = readByte((pos + 2));
+		block.is_second_chip = ((data_size >> 31) != 0);
+		block.offset = (pos + 7);
+		block.size = (data_size & 0x7FFFFFFF);
+
+		pos += 7;
+
+		if (!has_bytes(block.size))
+		{
+		    is_valid = false;
+		    break;
+		}
+
+		// ROM images start with their size and start address, and RAM images with their start address
+		uint8_t data_group = (block.data_type & 0xC0);
+		uint32_t header_size = (data_group == 0x80) ? 8 : (data_group == 0xC0) ? 2 : 0;
+
+		if (block.size < header_size)
+		{
+		    BEEVGM_LOG(LogWarning, "Skipping data block of type " << hex << int(block.data_type) << " that's too small to hold its header");
+		    num_invalid_blocks += 1;
+		    pos += block.size;
+		    break;
+		}
+
+		BeeVGMCommand cmd;
+		cmd.type = CmdDataBlock;
+		cmd.data = data_blocks.size();
+		data_blocks.push_back(block);
+		add_command(offset, cmd);
+
+		pos += block.size;
+	    }
+	    break;
+	    // PCM RAM write
+	    case 0x68:
+	    {
+		if (!has_bytes(12))
+		{
+		    is_valid = false;
+		    break;
+		}
+
+		BeeVGMRAMTransfer transfer;
+		transfer.chip_type = (readByte((pos + 2)) & 0x3F);
+		transfer.read_offs = readHLong((pos + 3));
+		transfer.write_offs = readHLong((pos + 6));
+		transfer.size = readHLong((pos + 9));
+
+		if (transfer.size == 0)
+		{
+		    transfer.size = 0x1000000;
+		}
+
+		BeeVGMCommand cmd;
+		cmd.type = CmdRAMWrite;
+		cmd.data = ram_transfers.size();
+		ram_transfers.push_back(transfer);
+		add_command(offset, cmd);
+
+		pos += 12;
+	    }
+	    break;
+	    // DAC stream setup
+	    case 0x90:
+	    {
+		if (!has_bytes(5))
+		{
+		    is_valid = false;
+		    break;
+		}
+
+		BeeVGMCommand cmd;
+		cmd.type = CmdStreamSetup;
+		cmd.instance = readByte((pos + 1));
+		cmd.chip = readByte((pos + 2));
+		cmd.port = readByte((pos + 3));
+		cmd.reg = readByte((pos + 4));
+		add_command(offset, cmd);
+		pos += 5;
+	    }
+	    break;
+	    // DAC stream data
+	    case 0x91:
+	    {
+		if (!has_bytes(5))
+		{
+		    is_valid = false;
+		    break;
+		}
+
+		BeeVGMCommand cmd;
+		cmd.type = CmdStreamData;
+		cmd.instance = readByte((pos + 1));
+		cmd.port = readByte((pos + 2));
+		cmd.reg = readByte((pos + 3));
+		cmd.value = readByte((pos + 4));
+		add_command(offset, cmd);
+		pos += 5;
+	    }
+	    break;
+	    // DAC stream frequency
+	    case 0x92:
+	    {
+		if (!has_bytes(6))
+		{
+		    is_valid = false;
+		    break;
+		}
+
+		BeeVGMCommand cmd;
+		cmd.type = CmdStreamFreq;
+		cmd.instance = readByte((pos + 1));
+		cmd.data = readLong((pos + 2));
+		add_command(offset, cmd);
+		pos += 6;
+	    }
+	    break;
+	    // DAC stream start
+	    case 0x93:
+	    {
+		if (!has_bytes(11))
+		{
+		    is_valid = false;
+		    break;
+		}
+
+		BeeVGMStreamStart start;
+		start.data_start = readLong((pos + 2));
+		start.length_mode = readByte((pos + 6));
+		start.length = readLong((pos + 7));
+
+		BeeVGMCommand cmd;
+		cmd.type = CmdStreamStart;
+		cmd.instance = readByte((pos + 1));
+		cmd.data = stream_starts.size();
+		stream_starts.push_back(start);
+		add_command(offset, cmd);
+		pos += 11;
+	    }
+	    break;
+	    // DAC stream stop
+	    case 0x94:
+	    {
+		if (!has_bytes(2))
+		{
+		    is_valid = false;
+		    break;
+		}
+
+		BeeVGMCommand cmd;
+		cmd.type = CmdStreamStop;
+		cmd.instance = readByte((pos + 1));
+		add_command(offset, cmd);
+		pos += 2;
+	    }
+	    break;
+	    // DAC stream fast start
+	    case 0x95:
+	    {
+		if (!has_bytes(5))
+		{
+		    is_valid = false;
+		    break;
+		}
+
+		BeeVGMCommand cmd;
+		cmd.type = CmdStreamStartFast;
+		cmd.instance = readByte((pos + 1));
+		cmd.reg = readWord((pos + 2));
+		cmd.port = readByte((pos + 4));
+		add_command(offset, cmd);
+		pos += 5;
+	    }
+	    break;
+	    // YM2612 chip 1 writes
+	    case 0xA2: is_valid = add_reg_write(ChipYM2612, 1, 0); break;
+	    case 0xA3: is_valid = add_reg_write(ChipYM2612, 1, 1); break;
+	    // RF5C68 register write
+	    case 0xB0: is_valid = add_reg_write(ChipRF5C68, 0, 0); break;
+	    // PWM register write
+	    case 0xB2:
+	    {
+		if (!has_bytes(3))
+		{
+		    is_valid = false;
+		    break;
+		}
+
+		uint8_t addr_byte = readByte((pos + 1));
+		uint8_t data_byte = readByte((pos + 2));
+
+		int reg = (addr_byte >> 4);
+		uint16_t value = (((addr_byte & 0xF) << 8) | data_byte);
+		add_write(offset, ChipPWM, 0, 0, reg, value);
+		pos += 3;
+	    }
+	    break;
+	    // MultiPCM register write
+	    case 0xB5:
+	    {
+		if (!has_bytes(3))
+		{
+		    is_valid = false;
+		    break;
+		}
+
+		uint8_t addr = readByte((pos + 1));
+		uint8_t instance = (addr >> 7);
+		add_write(offset, ChipMultiPCM, instance, 0, (addr & 0x7F), readByte((pos + 2)));
+		pos += 3;
+	    }
+	    break;
+	    // Sega PCM and RF5C68 RAM writes
+	    case 0xC0:
+	    case 0xC1:
+	    {
+		if (!has_bytes(4))
+		{
+		    is_valid = false;
+		    break;
+		}
+
+		BeeVGMCommand cmd;
+		cmd.type = CmdMemWrite;
+		cmd.chip = (vgm_instr == 0xC0) ? ChipSegaPCM : ChipRF5C68;
+		cmd.reg = readWord((pos + 1));
+		cmd.value = readByte((pos + 3));
+		add_command(offset, cmd);
+		pos += 4;
+	    }
+	    break;
+	    // MultiPCM bank offset set
+	    case 0xC3:
+	    {
+		if (!has_bytes(4))
+		{
+		    is_valid = false;
+		    break;
+		}
+
+		uint8_t channel = readByte((pos + 1));
+
+		BeeVGMCommand cmd;
+		cmd.type = CmdBankWrite;
+		cmd.chip = ChipMultiPCM;
+		cmd.instance = (channel >> 7);
+		cmd.reg = (channel & 0x7F);
+		cmd.value = readWord((pos + 2));
+		add_command(offset, cmd);
+		pos += 4;
+	    }
+	    break;
+	    // YMF278B and YMF271 register writes
+	    case 0xD0:
+	    case 0xD1:
+	    {
+		if (!has_bytes(4))
+		{
+		    is_valid = false;
+		    break;
+		}
+
+		uint8_t port = readByte((pos + 1));
+		BeeVGMChipID chip = (vgm_instr == 0xD0) ? ChipYMF278B : ChipYMF271;
+		add_write(offset, chip, (port >> 7), (port & 0x7F), readByte((pos + 2)), readByte((pos + 3)));
+		pos += 4;
+	    }
+	    break;
+	    // PCM offset
+	    case 0xE0:
+	    {
+		if (!has_bytes(5))
+		{
+		    is_valid = false;
+		    break;
+		}
+
+		BeeVGMCommand cmd;
+		cmd.type = CmdPCMSeek;
+		cmd.data = readLong((pos + 1));
+		add_command(offset, cmd);
+		pos += 5;
+	    }
+	    break;
+	    default:
+	    {
+		uint8_t vgm_nibble = (vgm_instr & 0xF);
+
+		switch ((vgm_instr & 0xF0))
+		{
+		    // Wait n+1 samples
+		    case 0x70: add_wait(offset, (vgm_nibble + 1)); pos += 1; break;
+		    // Write to YM2612 chip 0 DAC, then wait n samples
+		    case 0x80:
+		    {
+			BeeVGMCommand cmd;
+			cmd.type = CmdDACWrite;
+			cmd.chip = ChipYM2612;
+			cmd.wait = vgm_nibble;
+			add_command(offset, cmd);
+			pos += 1;
+		    }
+		    break;
+		    default:
+		    {
+			uint32_t cmd_length = get_command_length(vgm_instr);
+
+			// We don't know how long this command is, so this is as far as we go
+			if (cmd_length == 0)
+			{
+			    BeeVGMCommand cmd;
+			    cmd.type = CmdUnknown;
+			    cmd.data = vgm_instr;
+			    add_command(offset, cmd);
+			    is_end = true;
+			    break;
+			}
+
+			// Reserved, or for a chip that isn't emulated, so it's skipped
+			if (!has_bytes(cmd_length))
+			{
+			    is_valid = false;
+			    break;
+			}
+
+			if (!skipped_commands.test(vgm_instr))
+			{
+			    BEEVGM_LOG(LogWarning, "Skipping unsupported VGM instruction of " << hex << (int)vgm_instr);
+			    skipped_commands.set(vgm_instr);
+			}
+
+			pos += cmd_length;
+		    }
+		    break;
+		}
+	    }
+	    break;
+	}
+
+	// Truncated command at the end of the data (so far)
+	if (!is_valid)
+	{
+	    if (!is_final)
+	    {
+		compile_pos = offset;
+		return;
+	    }
+
+	    break;
+	}
+    }
+
+    // Ran out of data partway through a command, or without an end of stream command
+    is_cut_short = !is_end;
+
+    BeeVGMCommand end_cmd;
+    end_cmd.type = CmdEnd;
+    add_command(pos, end_cmd);
+    compile_pos = pos;
+    is_compiled = true;
+}
@@ -0,0 +1,239 @@
+/*
+    This file is part of the BeeVGM engine.
+    Copyright (C) 2022 BueniaDev.
+
+    BeeVGM is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    BeeVGM is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with BeeVGM.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// BeeVGM - pre-decoded VGM command stream
+//
+// The raw VGM command bytes are compiled once at load time into a flat
+// array of fixed-size commands, so playback (and looping) is a linear
+// scan over that array instead of re-parsing the file every time.
+//
+// Commands for chips that aren't emulated, and the ones the spec reserves
+// for future use, are skipped over while compiling (their lengths are all
+// fixed by the spec), so they cost nothing during playback. Only opcodes
+// the spec doesn't give a length for at all stop the stream, since there's
+// no telling where the next command starts.
+
+#ifndef BEEVGM_COMMAND_H
+#define BEEVGM_COMMAND_H
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <bitset>
+using namespace std;
+
+namespace beevgm
+{
+    enum BeeVGMChipID : uint8_t
+    {
+	ChipNone = 0,
+	ChipSN76489,
+	ChipYM2413,
+	ChipYM2612,
+	ChipYM2151,
+	ChipSegaPCM,
+	ChipRF5C68,
+	ChipYM2203,
+	ChipYM2610,
+	ChipYM3812,
+	ChipYM3526,
+	ChipY8950,
+	ChipYMF262,
+	ChipYMZ280B,
+	ChipMultiPCM,
+	ChipPWM,
+	ChipYMF278B,
+	ChipYMF271,
+    };
+
+    enum BeeVGMCommandType : uint8_t
+    {
+	// Register write ('port', 'reg' and 'value')
+	CmdWrite = 0,
+	// Memory write ('reg' holds the address)
+	CmdMemWrite,
+	// MultiPCM bank offset ('reg' holds the channel, 'value' the bank offset)
+	CmdBankWrite,
+	// Wait 'wait' samples
+	CmdWait,
+	// YM2612 DAC write from the PCM data bank, then wait 'wait' samples
+	CmdDACWrite,
+	// Seek to offset 'data' in the PCM data bank
+	CmdPCMSeek,
+	// Data block (index 'data' in the data block table)
+	CmdDataBlock,
+	// PCM RAM write (index 'data' in the RAM transfer table)
+	CmdRAMWrite,
+	// DAC stream setup (stream 'instance', chip type 'chip', port 'port', register 'reg')
+	CmdStreamSetup,
+	// DAC stream data (stream 'instance', bank 'port', step size 'reg', step base 'value')
+	CmdStreamData,
+	// DAC stream frequency (stream 'instance', frequency 'data')
+	CmdStreamFreq,
+	// DAC stream start (stream 'instance', index 'data' in the stream start table)
+	CmdStreamStart,
+	// DAC stream stop (stream 'instance', 0xFF stops all streams)
+	CmdStreamStop,
+	// DAC stream fast start (stream 'instance', block 'reg', flags 'port')
+	CmdStreamStartFast,
+	// Unrecognized instruction (opcode in 'data')
+	CmdUnknown,
+	// End of stream
+	CmdEnd,
+    };
+
+    struct BeeVGMCommand
+    {
+	uint8_t type = CmdEnd;
+	uint8_t chip = ChipNone;
+	uint8_t instance = 0;
+	uint8_t port = 0;
+	uint16_t reg = 0;
+	uint16_t value = 0;
+	uint32_t wait = 0;
+	uint32_t data = 0;
+    };
+
+    // Data block (command 0x67), which refers to the block's contents
+    // directly inside the loaded VGM data
+    struct BeeVGMDataBlock
+    {
+	uint8_t data_type = 0;
+	bool is_second_chip = false;
+	uint32_t offset = 0;
+	uint32_t size = 0;
+    };
+
+    // PCM RAM write (command 0x68)
+    struct BeeVGMRAMTransfer
+    {
+	uint8_t chip_type = 0;
+	uint32_t read_offs = 0;
+	uint32_t write_offs = 0;
+	uint32_t size = 0;
+    };
+
+    // DAC stream start (command 0x93)
+    struct BeeVGMStreamStart
+    {
+	uint32_t data_start = 0;
+	uint8_t length_mode = 0;
+	uint32_t length = 0;
+    };
+
+    class BeeVGMCommandStream
+    {
+	public:
+	    BeeVGMCommandStream();
+	    ~BeeVGMCommandStream();
+
+	    // Compiles the commands in 'size' bytes of 'data', starting at offset 'start_pos'
+	    void compile(const uint8_t *data, size_t size, uint32_t start_pos);
+	    void clear();
+
+	    // Compiling can also be done a bit at a time, as more of the data becomes
+	    // available (i.e. while it's being decompressed): begin() starts over at
+	    // offset 'start_pos', and compile_more() compiles whatever complete commands
+	    // are in the first 'size' bytes of 'data' (if 'is_final' is false, a command
+	    // that's cut off at the end is left until the next call)
+	    void begin(uint32_t start_pos);
+	    void compile_more(const uint8_t *data, size_t size, bool is_final);
+
+	    // Whether the end of the commands has been reached
+	    bool is_finished() const
+	    {
+		return is_compiled;
+	    }
+
+	    // Whether the data ran out partway through a command, or before an end of stream command
+	    bool is_truncated() const
+	    {
+		return is_cut_short;
+	    }
+
+	    // Whether any data blocks were skipped for being too small to hold
+	    // their own header (the sizes and offsets at the start of ROM/RAM images)
+	    bool has_invalid_blocks() const
+	    {
+		return (num_invalid_blocks != 0);
+	    }
+
+	    // Whether any commands with opcode 'vgm_instr' have been skipped
+	    bool is_skipped(uint8_t vgm_instr) const
+	    {
+		return skipped_commands.test(vgm_instr);
+	    }
+
+	    // Length in bytes (including the opcode) of a command, as given by the spec,
+	    // or 0 if it isn't fixed (data blocks) or the spec doesn't define the opcode
+	    static uint32_t get_command_length(uint8_t vgm_instr);
+
+	    size_t size() const
+	    {
+		return commands.size();
+	    }
+
+	    const BeeVGMCommand &at(size_t index) const
+	    {
+		return commands[index];
+	    }
+
+	    // File offset a command was compiled from
+	    uint32_t get_offset(size_t index) const
+	    {
+		return command_offsets.at(index);
+	    }
+
+	    // Index of the first command at or after file offset 'offset'
+	    size_t find_offset(uint32_t offset) const;
+
+	    const BeeVGMDataBlock &get_data_block(uint32_t index) const
+	    {
+		return data_blocks.at(index);
+	    }
+
+	    const BeeVGMRAMTransfer &get_ram_transfer(uint32_t index) const
+	    {
+		return ram_transfers.at(index);
+	    }
+
+	    const BeeVGMStreamStart &get_stream_start(uint32_t index) const
+	    {
+		return stream_starts.at(index);
+	    }
+
+	private:
+	    vector<BeeVGMCommand> commands;
+	    vector<uint32_t> command_offsets;
+	    vector<BeeVGMDataBlock> data_blocks;
+	    vector<BeeVGMRAMTransfer> ram_transfers;
+	    vector<BeeVGMStreamStart> stream_starts;
+
+	    uint32_t compile_pos = 0;
+	    bool is_compiled = false;
+	    bool is_cut_short = false;
+	    uint32_t num_invalid_blocks = 0;
+	    bitset<256> skipped_commands;
+
+	    void add_command(uint32_t offset, const BeeVGMCommand &cmd);
+	    void add_write(uint32_t offset, BeeVGMChipID chip, uint8_t instance, uint8_t port, uint16_t reg, uint16_t value);
+	    void add_wait(uint32_t offset, uint32_t num_samples);
+    };
+};
+
+#endif // BEEVGM_COMMAND_H
@@ -0,0 +1,199 @@
+/*
+    This file is part of the BeeVGM engine.
+    Copyright (C) 2022 BueniaDev.
+
+    BeeVGM is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    BeeVGM is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with BeeVGM.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include "beevgm_event.h"
+#include "beevgm_log.h"
+using namespace beevgm;
+using namespace std;
+
+BeeVGMEventReader::BeeVGMEventReader()
+{
+
+}
+
+BeeVGMEventReader::~BeeVGMEventReader()
+{
+
+}
+
+bool BeeVGMEventReader::load(vector<uint8_t> memory)
+{
+    clear();
+
+    if (!vgm_loader.assign(move(memory)))
+    {
+	return false;
+    }
+
+    vgm_data = vgm_loader.span();
+    return true;
+}
+
+bool BeeVGMEventReader::load(const uint8_t *data, size_t size)
+{
+    clear();
+
+    if (!vgm_loader.borrow(data, size))
+    {
+	return false;
+    }
+
+    vgm_data = vgm_loader.span();
+    return true;
+}
+
+bool BeeVGMEventReader::loadFile(string filename)
+{
+    clear();
+
+    if (!vgm_loader.open(filename))
+    {
+	return false;
+    }
+
+    vgm_data = vgm_loader.span();
+    return true;
+}
+
+void BeeVGMEventReader::clear()
+{
+    vgm_data = BeeVGMSpan();
+    pcm_banks.clear();
+    pcm_blocks_loaded = 0;
+    rewind();
+}
+
+bool BeeVGMEventReader::load_more()
+{
+    if (!vgm_loader.load_more(pcm_banks))
+    {
+	return false;
+    }
+
+    vgm_data = vgm_loader.span();
+    return true;
+}
+
+// The PCM banks are kept, since they'd be loaded the same way again
+void BeeVGMEventReader::rewind()
+{
+    cmd_pos = 0;
+    sample_time = 0;
+    pcm_pos = 0;
+    end_of_stream = false;
+}
+
+bool BeeVGMEventReader::next(BeeVGMEvent &event)
+{
+    const BeeVGMCommandStream &commands = vgm_loader.get_commands();
+
+    while (!end_of_stream)
+    {
+	while ((cmd_pos >= commands.size()) && load_more())
+	{
+	    continue;
+	}
+
+	if (cmd_pos >= commands.size())
+	{
+	    end_of_stream = true;
+	    break;
+	}
+
+	const BeeVGMCommand &cmd = commands.at(cmd_pos);
+	uint32_t cmd_offset = commands.get_offset(cmd_pos);
+	cmd_pos += 1;
+
+	if (cmd.type == CmdWait)
+	{
+	    sample_time += cmd.wait;
+	    continue;
+	}
+
+	if (cmd.type == CmdEnd)
+	{
+	    vgm_loader.check_end((cmd_pos - 1));
+	    end_of_stream = true;
+	    break;
+	}
+
+	event = BeeVGMEvent();
+	event.time = sample_time;
+	event.offset = cmd_offset;
+	event.type = BeeVGMCommandType(cmd.type);
+	event.chip = BeeVGMChipID(cmd.chip);
+	event.instance = cmd.instance;
+	event.port = cmd.port;
+	event.reg = cmd.reg;
+	event.value = cmd.value;
+	event.data = cmd.data;
+
+	switch (cmd.type)
+	{
+	    // Write to YM2612 chip 0 DAC, then wait n samples
+	    case CmdDACWrite:
+	    {
+		uint8_t data = 0x80;
+		const auto &ym2612_dac = pcm_banks[0x00];
+
+		if (ym2612_dac.is_valid(pcm_pos))
+		{
+		    data = ym2612_dac.read(pcm_pos++);
+		}
+
+		event.type = CmdWrite;
+		event.chip = ChipYM2612;
+		event.instance = 0;
+		event.port = 0;
+		event.reg = 0x2A;
+		event.value = data;
+		sample_time += cmd.wait;
+	    }
+	    break;
+	    case CmdPCMSeek: pcm_pos = cmd.data; break;
+	    case CmdDataBlock:
+	    {
+		event.data_block = commands.get_data_block(cmd.data);
+		event.block_data = vgm_data.subspan(event.data_block.offset, event.data_block.size);
+
+		// Stream data is loaded into the banks once, like in playback
+		if (cmd.data >= pcm_blocks_loaded)
+		{
+		    pcm_banks.add_stream_block(event.data_block.data_type, event.block_data);
+		    pcm_blocks_loaded = (cmd.data + 1);
+		}
+	    }
+	    break;
+	    case CmdRAMWrite: event.ram_transfer = commands.get_ram_transfer(cmd.data); break;
+	    case CmdStreamStart: event.stream_start = commands.get_stream_start(cmd.data); break;
+	    // Playback stops at an unrecognized command, so reading does too
+	    case CmdUnknown:
+	    {
+		vgm_loader.check_end((cmd_pos - 1));
+		end_of_stream = true;
+	    }
+	    break;
+	    default: break;
+	}
+
+	return true;
+    }
+
+    return false;
+}
@@ -0,0 +1,132 @@
+/*
+    This file is part of the BeeVGM engine.
+    Copyright (C) 2022 BueniaDev.
+
+    BeeVGM is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    BeeVGM is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with BeeVGM.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// BeeVGM - timestamped command events
+//
+// Walks the commands in a VGM file without creating (or clocking) any
+// sound chips, and hands each one back as an event, along with the
+// sample time it happens at. Waits aren't events themselves, and only
+// move the time along.
+//
+// YM2612 DAC writes (commands 0x80-0x8F) come back as ordinary register
+// writes, with the byte read from the PCM data bank like in playback.
+// DAC stream commands come back as they are; the writes a running
+// stream makes aren't expanded into events of their own, and commands
+// the command stream skips (see beevgm_command.h) don't come back at all.
+//
+// Reading stops at the end of the stream, so loops aren't followed
+// (events from the loop onwards have an offset at or after get_loop_offset()).
+
+#ifndef BEEVGM_EVENT_H
+#define BEEVGM_EVENT_H
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <string>
+#include "beevgm_command.h"
+#include "beevgm_loader.h"
+#include "beevgm_pcm.h"
+using namespace std;
+
+namespace beevgm
+{
+    struct BeeVGMEvent
+    {
+	// Sample time (at 44100 Hz) from the start of the file
+	uint64_t time = 0;
+	// File offset of the command
+	uint32_t offset = 0;
+
+	// These have the same meanings as in BeeVGMCommand
+	BeeVGMCommandType type = CmdEnd;
+	BeeVGMChipID chip = ChipNone;
+	uint8_t instance = 0;
+	uint8_t port = 0;
+	uint16_t reg = 0;
+	uint16_t value = 0;
+	uint32_t data = 0;
+
+	// Details of data blocks (CmdDataBlock), along with their contents
+	// (which are only valid until the next event is read)...
+	BeeVGMDataBlock data_block;
+	BeeVGMSpan block_data;
+	// ...PCM RAM writes (CmdRAMWrite)...
+	BeeVGMRAMTransfer ram_transfer;
+	// ...and DAC stream starts (CmdStreamStart)
+	BeeVGMStreamStart stream_start;
+    };
+
+    class BeeVGMEventReader
+    {
+	public:
+	    BeeVGMEventReader();
+	    ~BeeVGMEventReader();
+
+	    // These work just like their counterparts in BeeVGM
+	    bool load(vector<uint8_t> memory);
+	    bool load(const uint8_t *data, size_t size);
+	    bool loadFile(string filename);
+
+	    // Reads the next event, returning false once the end of the stream is reached
+	    bool next(BeeVGMEvent &event);
+	    // Goes back to the first event
+	    void rewind();
+
+	    // Sample time of the last event read (or, at the end, the length of the stream)
+	    uint64_t get_time() const
+	    {
+		return sample_time;
+	    }
+
+	    // File offset of the loop point (0 if there isn't one)
+	    uint32_t get_loop_offset() const
+	    {
+		return vgm_loader.get_loop_offset();
+	    }
+
+	    // First problem found since the file was loaded, just like BeeVGM::getError()
+	    // (reading stops early on an unrecognized command or truncated data, which
+	    // otherwise look the same as a proper end of stream)
+	    BeeVGMError get_error() const
+	    {
+		return vgm_loader.get_error();
+	    }
+
+	    const string &get_error_string() const
+	    {
+		return vgm_loader.get_error_string();
+	    }
+
+	private:
+	    BeeVGMLoader vgm_loader;
+	    BeeVGMSpan vgm_data;
+	    BeeVGMPCMBanks pcm_banks;
+
+	    size_t cmd_pos = 0;
+	    uint64_t sample_time = 0;
+	    uint32_t pcm_pos = 0;
+	    uint32_t pcm_blocks_loaded = 0;
+	    bool end_of_stream = false;
+
+	    void clear();
+	    bool load_more();
+    };
+};
+
+#endif // BEEVGM_EVENT_H
@@ -0,0 +1,258 @@
+/*
+    This file is part of the BeeVGM engine.
+    Copyright (C) 2022 BueniaDev.
+
+    BeeVGM is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    BeeVGM is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with BeeVGM.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <fstream>
+#include <algorithm>
+#include "beevgm_file.h"
+#include "beevgm_log.h"
+using namespace beevgm;
+using namespace std;
+
+#if defined(__unix__) || defined(__APPLE__)
+#define BEEVGM_HAS_MMAP
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+BeeVGMFile::BeeVGMFile()
+{
+
+}
+
+BeeVGMFile::~BeeVGMFile()
+{
+    close();
+}
+
+void BeeVGMFile::close()
+{
+    unmap_file();
+    file_data.clear();
+    file_data.shrink_to_fit();
+    compressed_data.clear();
+    compressed_data.shrink_to_fit();
+    is_inflating = false;
+    is_inflate_error = false;
+    file_span = BeeVGMSpan();
+}
+
+bool BeeVGMFile::is_compressed(const uint8_t *data, size_t size)
+{
+    return (size >= 10 && (data[0] == 0x1F && data[1] == 0x8B && data[2] == 0x08));
+}
+
+bool BeeVGMFile::open(string filename)
+{
+    close();
+
+    if (!map_file(filename) && !read_file(filename))
+    {
+	return false;
+    }
+
+    if (is_compressed(file_span.data(), file_span.size()))
+    {
+	// The mapping is kept around until decompression is finished
+	if (is_mapped())
+	{
+	    return start_inflate(file_span.data(), file_span.size());
+	}
+	else
+	{
+	    compressed_data = move(file_data);
+	    file_data = vector<uint8_t>();
+	    return start_inflate(compressed_data.data(), compressed_data.size());
+	}
+    }
+
+    return true;
+}
+
+bool BeeVGMFile::assign(vector<uint8_t> memory)
+{
+    close();
+
+    if (is_compressed(memory.data(), memory.size()))
+    {
+	compressed_data = move(memory);
+	return start_inflate(compressed_data.data(), compressed_data.size());
+    }
+
+    file_data = move(memory);
+    file_span = BeeVGMSpan(file_data.data(), file_data.size());
+    return !file_span.empty();
+}
+
+bool BeeVGMFile::borrow(const uint8_t *data, size_t size)
+{
+    close();
+
+    if (is_compressed(data, size))
+    {
+	return start_inflate(data, size);
+    }
+
+    file_span = BeeVGMSpan(data, size);
+    return !file_span.empty();
+}
+
+bool BeeVGMFile::start_inflate(const uint8_t *data, size_t size)
+{
+    file_data.clear();
+    file_span = BeeVGMSpan(file_data.data(), 0);
+
+    if (!inflater.begin(data, size))
+    {
+	BEEVGM_LOG(LogError, "Error decompressing data from file");
+	close();
+	is_inflate_error = true;
+	return false;
+    }
+
+    // The gzip trailer's size is only a hint (it's modulo 4 GiB, and could be
+    // anything on a damaged file), so it's capped at the most that deflate
+    // could possibly expand this much data to
+    size_t size_hint = min<size_t>(inflater.get_size_hint(), (size * 1032));
+    file_data.reserve((size_hint + inflate_chunk_size + 1024));
+
+    is_inflating = true;
+    return ensure_size(1);
+}
+
+size_t BeeVGMFile::inflate_more(size_t max_bytes)
+{
+    if (!is_inflating)
+    {
+	return 0;
+    }
+
+    size_t prev_size = file_data.size();
+    BeeVGMInflateStatus status = inflater.inflate(file_data, min(max_bytes, inflate_chunk_size));
+
+    if (status == InflateError)
+    {
+	BEEVGM_LOG(LogError, "Error decompressing data from file");
+	is_inflate_error = true;
+    }
+
+    if (status != InflateOK)
+    {
+	finish_inflate();
+    }
+
+    file_span = BeeVGMSpan(file_data.data(), file_data.size());
+    return (file_data.size() - prev_size);
+}
+
+bool BeeVGMFile::ensure_size(size_t size)
+{
+    while ((file_span.size() < size) && is_inflating)
+    {
+	inflate_more(inflate_chunk_size);
+    }
+
+    return (file_span.size() >= size);
+}
+
+// Frees up the compressed data, which isn't needed anymore
+void BeeVGMFile::finish_inflate()
+{
+    is_inflating = false;
+    unmap_file();
+    compressed_data.clear();
+    compressed_data.shrink_to_fit();
+}
+
+bool BeeVGMFile::read_file(string filename)
+{
+    ifstream file(filename.c_str(), ios::in | ios::binary | ios::ate);
+
+    if (!file.is_open())
+    {
+	return false;
+    }
+
+    streampos size = file.tellg();
+    file_data.resize(size, 0);
+    file.seekg(0, ios::beg);
+    file.read((char*)file_data.data(), file_data.size());
+    file.close();
+
+    file_span = BeeVGMSpan(file_data.data(), file_data.size());
+    return !file_span.empty();
+}
+
+#ifdef BEEVGM_HAS_MMAP
+
+bool BeeVGMFile::map_file(string filename)
+{
+    int fd = ::open(filename.c_str(), O_RDONLY);
+
+    if (fd < 0)
+    {
+	return false;
+    }
+
+    struct stat file_stat;
+
+    if ((fstat(fd, &file_stat) != 0) || (file_stat.st_size <= 0))
+    {
+	::close(fd);
+	return false;
+    }
+
+    size_t size = file_stat.st_size;
+    void *ptr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+
+    if (ptr == MAP_FAILED)
+    {
+	return false;
+    }
+
+    map_ptr = ptr;
+    map_size = size;
+    file_span = BeeVGMSpan(reinterpret_cast<const uint8_t*>(ptr), size);
+    return true;
+}
+
+void BeeVGMFile::unmap_file()
+{
+    if (map_ptr != nullptr)
+    {
+	munmap(map_ptr, map_size);
+	map_ptr = nullptr;
+	map_size = 0;
+    }
+}
+
+#else
+
+bool BeeVGMFile::map_file(string filename)
+{
+    return false;
+}
+
+void BeeVGMFile::unmap_file()
+{
+    return;
+}
+
+#endif // BEEVGM_HAS_MMAP
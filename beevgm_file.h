@@ -0,0 +1,174 @@
+/*
+    This file is part of the BeeVGM engine.
+    Copyright (C) 2022 BueniaDev.
+
+    BeeVGM is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    BeeVGM is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with BeeVGM.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// BeeVGM - VGM data storage
+//
+// Holds the loaded VGM data, which is either memory-mapped straight
+// from the file, owned by the engine (i.e. decompressed .vgz data),
+// or borrowed from the caller, without any further copies.
+//
+// Compressed data is decompressed on demand (see inflate_more()), so
+// playback can start as soon as the start of the file is available.
+
+#ifndef BEEVGM_FILE_H
+#define BEEVGM_FILE_H
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <string>
+#include <stdexcept>
+#include "beevgm_inflate.h"
+using namespace std;
+
+namespace beevgm
+{
+    // Non-owning view of a block of bytes
+    class BeeVGMSpan
+    {
+	public:
+	    BeeVGMSpan()
+	    {
+
+	    }
+
+	    BeeVGMSpan(const uint8_t *data, size_t size) : span_data(data), span_size(size)
+	    {
+
+	    }
+
+	    const uint8_t *data() const
+	    {
+		return span_data;
+	    }
+
+	    size_t size() const
+	    {
+		return span_size;
+	    }
+
+	    bool empty() const
+	    {
+		return (span_size == 0);
+	    }
+
+	    uint8_t operator [](size_t addr) const
+	    {
+		return span_data[addr];
+	    }
+
+	    uint8_t at(size_t addr) const
+	    {
+		if (addr >= span_size)
+		{
+		    throw out_of_range("Invalid VGM data offset");
+		}
+
+		return span_data[addr];
+	    }
+
+	    // Returns a view of 'size' bytes starting at 'offset'
+	    BeeVGMSpan subspan(size_t offset, size_t size) const
+	    {
+		if ((offset > span_size) || (size > (span_size - offset)))
+		{
+		    throw out_of_range("Invalid VGM data range");
+		}
+
+		return BeeVGMSpan((span_data + offset), size);
+	    }
+
+	private:
+	    const uint8_t *span_data = nullptr;
+	    size_t span_size = 0;
+    };
+
+    class BeeVGMFile
+    {
+	public:
+	    BeeVGMFile();
+	    ~BeeVGMFile();
+
+	    BeeVGMFile(const BeeVGMFile&) = delete;
+	    BeeVGMFile &operator=(const BeeVGMFile&) = delete;
+
+	    // Maps (or, for .vgz files, starts decompressing) a file from disk
+	    bool open(string filename);
+	    // Takes ownership of 'memory', which can be compressed
+	    bool assign(vector<uint8_t> memory);
+	    // Refers to memory owned by the caller, which must outlive this object
+	    // (or, if it's compressed, until it's been completely decompressed)
+	    bool borrow(const uint8_t *data, size_t size);
+	    void close();
+
+	    // The span covers as much of the data as has been decompressed so far,
+	    // and is moved elsewhere in memory whenever decompressing needs more room
+	    BeeVGMSpan span() const
+	    {
+		return file_span;
+	    }
+
+	    bool is_mapped() const
+	    {
+		return (map_ptr != nullptr);
+	    }
+
+	    // Whether all of the data is available (i.e. decompression is finished)
+	    bool is_complete() const
+	    {
+		return !is_inflating;
+	    }
+
+	    // Whether decompression stopped early because the compressed data is damaged
+	    // (what was decompressed before that point is still available)
+	    bool is_damaged() const
+	    {
+		return is_inflate_error;
+	    }
+
+	    // Largest amount of data decompressed in one go
+	    static constexpr size_t inflate_chunk_size = 65536;
+
+	    // Decompresses up to 'max_bytes' more bytes, returning the number of bytes added
+	    size_t inflate_more(size_t max_bytes = inflate_chunk_size);
+	    // Decompresses until at least 'size' bytes are available (or there's no more data)
+	    bool ensure_size(size_t size);
+
+	    static bool is_compressed(const uint8_t *data, size_t size);
+
+	private:
+	    BeeVGMSpan file_span;
+	    vector<uint8_t> file_data;
+
+	    void *map_ptr = nullptr;
+	    size_t map_size = 0;
+
+	    BeeVGMInflater inflater;
+	    vector<uint8_t> compressed_data;
+	    bool is_inflating = false;
+	    bool is_inflate_error = false;
+
+	    bool map_file(string filename);
+	    bool read_file(string filename);
+	    void unmap_file();
+	    bool start_inflate(const uint8_t *data, size_t size);
+	    void finish_inflate();
+    };
+};
+
+#endif // BEEVGM_FILE_H
@@ -0,0 +1,618 @@
+/*
+    This file is part of the BeeVGM engine.
+    Copyright (C) 2022 BueniaDev.
+
+    BeeVGM is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    BeeVGM is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with BeeVGM.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <cstring>
+#include <algorithm>
+#include "beevgm_inflate.h"
+using namespace beevgm;
+using namespace std;
+
+static constexpr uint16_t length_base[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+
+static constexpr uint8_t length_extra[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+
+static constexpr uint16_t dist_base[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+};
+
+static constexpr uint8_t dist_extra[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+
+// Longest output of a single symbol (a match of 258 bytes),
+// plus room for match copies to run over by up to 8 bytes
+static constexpr size_t max_symbol_bytes = (258 + 8);
+
+bool BeeVGMHuffman::build(const uint8_t *lengths, int num_symbols)
+{
+    counts.fill(0);
+    fast.fill(0);
+
+    for (int symbol = 0; symbol < num_symbols; symbol++)
+    {
+	counts[lengths[symbol]] += 1;
+    }
+
+    counts[0] = 0;
+
+    // Reject over-subscribed codes (incomplete ones are allowed, as in zlib)
+    int left = 1;
+
+    for (int length = 1; length <= max_bits; length++)
+    {
+	left <<= 1;
+	left -= counts[length];
+
+	if (left < 0)
+	{
+	    return false;
+	}
+    }
+
+    array<uint16_t, (max_bits + 1)> offsets;
+    offsets[1] = 0;
+
+    for (int length = 1; length < max_bits; length++)
+    {
+	offsets[(length + 1)] = (offsets[length] + counts[length]);
+    }
+
+    for (int symbol = 0; symbol < num_symbols; symbol++)
+    {
+	if (lengths[symbol] != 0)
+	{
+	    symbols[offsets[lengths[symbol]]++] = symbol;
+	}
+    }
+
+    // Codes are stored most significant bit first in a stream that's
+    // read least significant bit first, so the lookup table is indexed
+    // by the bit-reversed code
+    int code = 0;
+    int index = 0;
+
+    for (int length = 1; length <= fast_bits; length++)
+    {
+	for (int count = 0; count < counts[length]; count++)
+	{
+	    int reversed = 0;
+
+	    for (int bit = 0; bit < length; bit++)
+	    {
+		reversed |= (((code >> bit) & 1) << ((length - 1) - bit));
+	    }
+
+	    uint16_t entry = ((symbols[index] << 4) | length);
+
+	    for (int fill = reversed; fill < (1 << fast_bits); fill += (1 << length))
+	    {
+		fast[fill] = entry;
+	    }
+
+	    code += 1;
+	    index += 1;
+	}
+
+	code <<= 1;
+    }
+
+    return true;
+}
+
+BeeVGMInflater::BeeVGMInflater()
+{
+
+}
+
+BeeVGMInflater::~BeeVGMInflater()
+{
+
+}
+
+bool BeeVGMInflater::begin(const uint8_t *data, size_t size)
+{
+    in_data = data;
+    in_size = size;
+    in_pos = 0;
+    bit_buf = 0;
+    bit_count = 0;
+    pad_bits = 0;
+    is_final_block = false;
+    stored_remaining = 0;
+    size_hint = 0;
+
+    if (size >= 18)
+    {
+	const uint8_t *end = &data[size];
+	size_hint = (end[-4] | (end[-3] << 8) | (end[-2] << 16) | (end[-1] << 24));
+    }
+
+    if (!parse_gzip_header())
+    {
+	inflate_state = StateError;
+	return false;
+    }
+
+    inflate_state = StateBlockHeader;
+    return true;
+}
+
+bool BeeVGMInflater::parse_gzip_header()
+{
+    if ((in_size < 10) || (in_data[0] != 0x1F) || (in_data[1] != 0x8B) || (in_data[2] != 0x08))
+    {
+	return false;
+    }
+
+    uint8_t flags = in_data[3];
+    size_t pos = 10;
+
+    // Extra field
+    if (flags & 0x04)
+    {
+	if ((pos + 2) > in_size)
+	{
+	    return false;
+	}
+
+	pos += (2 + (in_data[pos] | (in_data[(pos + 1)] << 8)));
+    }
+
+    // File name and comment (both zero-terminated)
+    for (uint8_t flag : {0x08, 0x10})
+    {
+	if (flags & flag)
+	{
+	    while ((pos < in_size) && (in_data[pos] != 0))
+	    {
+		pos += 1;
+	    }
+
+	    pos += 1;
+	}
+    }
+
+    // Header CRC
+    if (flags & 0x02)
+    {
+	pos += 2;
+    }
+
+    if (pos >= in_size)
+    {
+	return false;
+    }
+
+    in_pos = pos;
+    return true;
+}
+
+void BeeVGMInflater::refill()
+{
+    // Fast path, which tops the buffer up with a single 8-byte load
+    if ((in_pos + 8) <= in_size)
+    {
+	uint64_t next_bytes = 0;
+
+	for (int index = 0; index < 8; index++)
+	{
+	    next_bytes |= (uint64_t(in_data[(in_pos + index)]) << (index * 8));
+	}
+
+	bit_buf |= (next_bytes << bit_count);
+	in_pos += ((63 - bit_count) >> 3);
+	bit_count |= 56;
+	return;
+    }
+
+    while (bit_count <= 56)
+    {
+	if (in_pos < in_size)
+	{
+	    bit_buf |= (uint64_t(in_data[in_pos++]) << bit_count);
+	}
+	else
+	{
+	    pad_bits += 8;
+	}
+
+	bit_count += 8;
+    }
+}
+
+uint32_t BeeVGMInflater::getbits(int num_bits)
+{
+    if (bit_count < num_bits)
+    {
+	refill();
+    }
+
+    uint32_t value = uint32_t(bit_buf & ((uint64_t(1) << num_bits) - 1));
+    bit_buf >>= num_bits;
+    bit_count -= num_bits;
+    return value;
+}
+
+// True once any of the zero bits padded past the end of the input have been used
+bool BeeVGMInflater::is_overrun() const
+{
+    return (bit_count < pad_bits);
+}
+
+int BeeVGMInflater::decode(const BeeVGMHuffman &table)
+{
+    if (bit_count < BeeVGMHuffman::max_bits)
+    {
+	refill();
+    }
+
+    uint16_t entry = table.fast[(bit_buf & ((1 << BeeVGMHuffman::fast_bits) - 1))];
+
+    if (entry != 0)
+    {
+	int length = (entry & 0xF);
+	bit_buf >>= length;
+	bit_count -= length;
+	return (entry >> 4);
+    }
+
+    // Codes longer than the lookup table, decoded a bit at a time
+    int code = 0;
+    int first = 0;
+    int index = 0;
+
+    for (int length = 1; length <= BeeVGMHuffman::max_bits; length++)
+    {
+	code |= int((bit_buf >> (length - 1)) & 1);
+	int count = table.counts[length];
+
+	if ((code - count) < first)
+	{
+	    bit_buf >>= length;
+	    bit_count -= length;
+	    return table.symbols[(index + (code - first))];
+	}
+
+	index += count;
+	first += count;
+	first <<= 1;
+	code <<= 1;
+    }
+
+    return -1;
+}
+
+void BeeVGMInflater::build_fixed_tables()
+{
+    array<uint8_t, 288> lengths;
+
+    fill(lengths.begin(), (lengths.begin() + 144), 8);
+    fill((lengths.begin() + 144), (lengths.begin() + 256), 9);
+    fill((lengths.begin() + 256), (lengths.begin() + 280), 7);
+    fill((lengths.begin() + 280), lengths.end(), 8);
+    lit_table.build(lengths.data(), 288);
+
+    fill(lengths.begin(), (lengths.begin() + 30), 5);
+    dist_table.build(lengths.data(), 30);
+}
+
+bool BeeVGMInflater::read_dynamic_tables()
+{
+    static constexpr uint8_t order[19] = {
+	16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15
+    };
+
+    int num_lit = (getbits(5) + 257);
+    int num_dist = (getbits(5) + 1);
+    int num_codes = (getbits(4) + 4);
+
+    if ((num_lit > 286) || (num_dist > 30))
+    {
+	return false;
+    }
+
+    array<uint8_t, 19> code_lengths;
+    code_lengths.fill(0);
+
+    for (int index = 0; index < num_codes; index++)
+    {
+	code_lengths[order[index]] = getbits(3);
+    }
+
+    BeeVGMHuffman code_table;
+
+    if (!code_table.build(code_lengths.data(), 19))
+    {
+	return false;
+    }
+
+    array<uint8_t, (286 + 30)> lengths;
+    lengths.fill(0);
+
+    int index = 0;
+
+    while (index < (num_lit + num_dist))
+    {
+	int symbol = decode(code_table);
+
+	if ((symbol < 0) || is_overrun())
+	{
+	    return false;
+	}
+
+	if (symbol < 16)
+	{
+	    lengths[index++] = symbol;
+	    continue;
+	}
+
+	int repeat = 0;
+	uint8_t length = 0;
+
+	switch (symbol)
+	{
+	    case 16:
+	    {
+		if (index == 0)
+		{
+		    return false;
+		}
+
+		length = lengths[(index - 1)];
+		repeat = (3 + getbits(2));
+	    }
+	    break;
+	    case 17: repeat = (3 + getbits(3)); break;
+	    default: repeat = (11 + getbits(7)); break;
+	}
+
+	if ((index + repeat) > (num_lit + num_dist))
+	{
+	    return false;
+	}
+
+	while (repeat--)
+	{
+	    lengths[index++] = length;
+	}
+    }
+
+    // There has to be a code for the end of block symbol
+    if (lengths[256] == 0)
+    {
+	return false;
+    }
+
+    if (!lit_table.build(lengths.data(), num_lit))
+    {
+	return false;
+    }
+
+    return dist_table.build((lengths.data() + num_lit), num_dist);
+}
+
+bool BeeVGMInflater::read_block_header()
+{
+    is_final_block = (getbits(1) != 0);
+    uint32_t block_type = getbits(2);
+
+    switch (block_type)
+    {
+	// Stored
+	case 0:
+	{
+	    // Skip to the next byte boundary, then hand the rest of the
+	    // buffered bytes back to the input
+	    getbits((bit_count & 7));
+
+	    if (is_overrun())
+	    {
+		return false;
+	    }
+
+	    size_t num_bytes = ((bit_count - pad_bits) / 8);
+	    in_pos -= num_bytes;
+	    bit_buf = 0;
+	    bit_count = 0;
+	    pad_bits = 0;
+
+	    if ((in_pos + 4) > in_size)
+	    {
+		return false;
+	    }
+
+	    uint16_t length = (in_data[in_pos] | (in_data[(in_pos + 1)] << 8));
+	    uint16_t inv_length = (in_data[(in_pos + 2)] | (in_data[(in_pos + 3)] << 8));
+	    in_pos += 4;
+
+	    if (length != uint16_t(~inv_length))
+	    {
+		return false;
+	    }
+
+	    stored_remaining = length;
+	    inflate_state = StateStored;
+	}
+	break;
+	// Fixed Huffman codes
+	case 1:
+	{
+	    build_fixed_tables();
+	    inflate_state = StateHuffman;
+	}
+	break;
+	// Dynamic Huffman codes
+	case 2:
+	{
+	    if (!read_dynamic_tables())
+	    {
+		return false;
+	    }
+
+	    inflate_state = StateHuffman;
+	}
+	break;
+	default: return false;
+    }
+
+    return !is_overrun();
+}
+
+bool BeeVGMInflater::inflate_stored(vector<uint8_t> &out, size_t out_limit)
+{
+    size_t out_pos = out.size();
+    size_t num_bytes = min({stored_remaining, (in_size - in_pos), (out_limit - out_pos)});
+
+    out.insert(out.end(), (in_data + in_pos), (in_data + in_pos + num_bytes));
+    in_pos += num_bytes;
+    stored_remaining -= num_bytes;
+
+    if (stored_remaining == 0)
+    {
+	inflate_state = is_final_block ? StateDone : StateBlockHeader;
+    }
+    else if (in_pos >= in_size)
+    {
+	// Truncated
+	return false;
+    }
+
+    return true;
+}
+
+bool BeeVGMInflater::inflate_huffman(vector<uint8_t> &out, size_t out_limit)
+{
+    // Room for the last symbol to run past the limit
+    size_t out_pos = out.size();
+    out.resize((out_limit + max_symbol_bytes));
+    uint8_t *out_ptr = out.data();
+
+    bool is_ok = true;
+
+    while (out_pos < out_limit)
+    {
+	int symbol = decode(lit_table);
+
+	if ((symbol < 0) || is_overrun())
+	{
+	    is_ok = false;
+	    break;
+	}
+
+	if (symbol < 256)
+	{
+	    out_ptr[out_pos++] = symbol;
+	    continue;
+	}
+
+	if (symbol == 256)
+	{
+	    inflate_state = is_final_block ? StateDone : StateBlockHeader;
+	    break;
+	}
+
+	symbol -= 257;
+
+	if (symbol >= 29)
+	{
+	    is_ok = false;
+	    break;
+	}
+
+	size_t length = (length_base[symbol] + getbits(length_extra[symbol]));
+	int dist_symbol = decode(dist_table);
+
+	if ((dist_symbol < 0) || (dist_symbol >= 30))
+	{
+	    is_ok = false;
+	    break;
+	}
+
+	size_t distance = (dist_base[dist_symbol] + getbits(dist_extra[dist_symbol]));
+
+	// Anything read past the end of the input is garbage, so the match is dropped
+	if ((distance > out_pos) || is_overrun())
+	{
+	    is_ok = false;
+	    break;
+	}
+
+	uint8_t *dst = (out_ptr + out_pos);
+	const uint8_t *src = (dst - distance);
+
+	if (distance >= 8)
+	{
+	    // Copies 8 bytes at a time, which can run past the end of the match
+	    // (into space that's either overwritten later or cut off at the end)
+	    for (size_t index = 0; index < length; index += 8)
+	    {
+		memcpy((dst + index), (src + index), 8);
+	    }
+	}
+	else
+	{
+	    for (size_t index = 0; index < length; index++)
+	    {
+		dst[index] = src[index];
+	    }
+	}
+
+	out_pos += length;
+    }
+
+    out.resize(out_pos);
+    return is_ok;
+}
+
+BeeVGMInflateStatus BeeVGMInflater::inflate(vector<uint8_t> &out, size_t max_bytes)
+{
+    size_t out_limit = (out.size() + max_bytes);
+
+    while ((out.size() < out_limit) && !is_done())
+    {
+	bool is_ok = true;
+
+	switch (inflate_state)
+	{
+	    case StateBlockHeader: is_ok = read_block_header(); break;
+	    case StateStored: is_ok = inflate_stored(out, out_limit); break;
+	    case StateHuffman: is_ok = inflate_huffman(out, out_limit); break;
+	    default: break;
+	}
+
+	if (!is_ok)
+	{
+	    inflate_state = StateError;
+	}
+    }
+
+    switch (inflate_state)
+    {
+	case StateDone: return InflateDone;
+	case StateError: return InflateError;
+	default: return InflateOK;
+    }
+}
@@ -0,0 +1,132 @@
+/*
+    This file is part of the BeeVGM engine.
+    Copyright (C) 2022 BueniaDev.
+
+    BeeVGM is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    BeeVGM is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with BeeVGM.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// BeeVGM - incremental gzip decompression
+//
+// Decompresses a gzip stream a chunk at a time onto the end of an output
+// buffer, which doubles as the sliding window (since the whole of the
+// decompressed data is kept around for playback anyway).
+//
+// The output size is never taken from the gzip trailer (which only holds
+// the size modulo 4 GiB, and can't be trusted on truncated files), and
+// running out of input simply ends the data early.
+
+#ifndef BEEVGM_INFLATE_H
+#define BEEVGM_INFLATE_H
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <array>
+using namespace std;
+
+namespace beevgm
+{
+    enum BeeVGMInflateStatus
+    {
+	InflateOK = 0,
+	InflateDone,
+	InflateError,
+    };
+
+    // Canonical Huffman decoding table, with a lookup table for short codes
+    struct BeeVGMHuffman
+    {
+	static constexpr int max_bits = 15;
+	static constexpr int fast_bits = 10;
+
+	array<uint16_t, (max_bits + 1)> counts;
+	array<uint16_t, 288> symbols;
+	// Entries are (symbol << 4) | code length, or 0 for codes longer than 'fast_bits'
+	array<uint16_t, (1 << fast_bits)> fast;
+
+	bool build(const uint8_t *lengths, int num_symbols);
+    };
+
+    class BeeVGMInflater
+    {
+	public:
+	    BeeVGMInflater();
+	    ~BeeVGMInflater();
+
+	    // Starts decompressing 'size' bytes of gzip data at 'data',
+	    // which must stay alive until decompression is done
+	    bool begin(const uint8_t *data, size_t size);
+
+	    // Decompresses roughly 'max_bytes' more bytes onto the end of 'out'
+	    BeeVGMInflateStatus inflate(vector<uint8_t> &out, size_t max_bytes);
+
+	    bool is_done() const
+	    {
+		return (inflate_state == StateDone) || (inflate_state == StateError);
+	    }
+
+	    bool is_error() const
+	    {
+		return (inflate_state == StateError);
+	    }
+
+	    // Uncompressed size from the gzip trailer (modulo 4 GiB, so only good as a hint)
+	    uint32_t get_size_hint() const
+	    {
+		return size_hint;
+	    }
+
+	private:
+	    enum InflateState
+	    {
+		StateBlockHeader,
+		StateStored,
+		StateHuffman,
+		StateDone,
+		StateError,
+	    };
+
+	    const uint8_t *in_data = nullptr;
+	    size_t in_size = 0;
+	    size_t in_pos = 0;
+
+	    uint64_t bit_buf = 0;
+	    int bit_count = 0;
+	    // Number of zero bits padded onto the end of the input
+	    int pad_bits = 0;
+
+	    InflateState inflate_state = StateDone;
+	    bool is_final_block = false;
+	    size_t stored_remaining = 0;
+	    uint32_t size_hint = 0;
+
+	    BeeVGMHuffman lit_table;
+	    BeeVGMHuffman dist_table;
+
+	    void refill();
+	    uint32_t getbits(int num_bits);
+	    bool is_overrun() const;
+	    int decode(const BeeVGMHuffman &table);
+
+	    bool parse_gzip_header();
+	    bool read_block_header();
+	    bool read_dynamic_tables();
+	    void build_fixed_tables();
+
+	    bool inflate_stored(vector<uint8_t> &out, size_t out_limit);
+	    bool inflate_huffman(vector<uint8_t> &out, size_t out_limit);
+    };
+};
+
+#endif // BEEVGM_INFLATE_H
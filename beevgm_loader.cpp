@@ -0,0 +1,196 @@
+/*
+    This file is part of the BeeVGM engine.
+    Copyright (C) 2022 BueniaDev.
+
+    BeeVGM is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    BeeVGM is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with BeeVGM.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <sstream>
+#include "beevgm_loader.h"
+#include "beevgm_log.h"
+using namespace beevgm;
+using namespace std;
+
+BeeVGMLoader::BeeVGMLoader()
+{
+
+}
+
+BeeVGMLoader::~BeeVGMLoader()
+{
+
+}
+
+bool BeeVGMLoader::open(string filename)
+{
+    close();
+
+    if (!vgm_file.open(filename))
+    {
+	set_error((vgm_file.is_damaged() ? ErrorDecompress : ErrorFileOpen), "Could not load VGM data");
+	return false;
+    }
+
+    return parse_header();
+}
+
+bool BeeVGMLoader::assign(vector<uint8_t> memory)
+{
+    close();
+
+    if (!vgm_file.assign(move(memory)))
+    {
+	set_error((vgm_file.is_damaged() ? ErrorDecompress : ErrorFileOpen), "Could not load VGM data");
+	return false;
+    }
+
+    return parse_header();
+}
+
+bool BeeVGMLoader::borrow(const uint8_t *data, size_t size)
+{
+    close();
+
+    if (!vgm_file.borrow(data, size))
+    {
+	set_error((vgm_file.is_damaged() ? ErrorDecompress : ErrorFileOpen), "Could not load VGM data");
+	return false;
+    }
+
+    return parse_header();
+}
+
+void BeeVGMLoader::close()
+{
+    vgm_file.close();
+    vgm_data = BeeVGMSpan();
+    commands.clear();
+
+    version = 0;
+    data_offset = 0;
+    loop_offset = 0;
+    gd3_offset = 0;
+
+    error_code = ErrorNone;
+    error_str.clear();
+}
+
+void BeeVGMLoader::set_error(BeeVGMError error, string msg)
+{
+    if (error_code != ErrorNone)
+    {
+	return;
+    }
+
+    BEEVGM_LOG(LogError, msg);
+    error_code = error;
+    error_str = msg;
+}
+
+uint32_t BeeVGMLoader::read_long(uint32_t addr) const
+{
+    return (vgm_data[addr] | (vgm_data[(addr + 1)] << 8) | (vgm_data[(addr + 2)] << 16) | (vgm_data[(addr + 3)] << 24));
+}
+
+bool BeeVGMLoader::parse_header()
+{
+    vgm_file.ensure_size(64);
+    vgm_data = vgm_file.span();
+
+    if ((vgm_data.size() < 64) || vgm_data[0] != 'V' || vgm_data[1] != 'g' || vgm_data[2] != 'm' || vgm_data[3] != ' ')
+    {
+	set_error(ErrorInvalidData, "Data does not appear to be valid VGM data.");
+	vgm_file.close();
+	vgm_data = BeeVGMSpan();
+	return false;
+    }
+
+    version = read_long(0x8);
+    data_offset = (version >= 0x150) ? (0x34 + read_long(0x34)) : 0x40;
+
+    // Make sure the rest of the header is there for compressed files
+    vgm_file.ensure_size(max<size_t>(data_offset, 0x100));
+    vgm_data = vgm_file.span();
+
+    if (data_offset > vgm_data.size())
+    {
+	set_error(ErrorInvalidData, "VGM data offset points past the end of the file");
+	vgm_file.close();
+	vgm_data = BeeVGMSpan();
+	return false;
+    }
+
+    uint32_t loop_offs = read_long(0x1C);
+    loop_offset = (loop_offs != 0) ? (0x1C + loop_offs) : 0;
+
+    uint32_t gd3_offs = read_long(0x14);
+    gd3_offset = (gd3_offs != 0) ? (0x14 + gd3_offs) : 0;
+
+    commands.begin(data_offset);
+    compile_commands();
+    return true;
+}
+
+bool BeeVGMLoader::load_more(BeeVGMPCMBanks &pcm_banks)
+{
+    if (vgm_file.is_complete())
+    {
+	return false;
+    }
+
+    BeeVGMSpan prev_data = vgm_data;
+    vgm_file.inflate_more();
+    vgm_data = vgm_file.span();
+
+    if (vgm_file.is_damaged())
+    {
+	set_error(ErrorDecompress, "Compressed VGM data is damaged, stopping where the damage starts");
+    }
+
+    if (vgm_data.data() != prev_data.data())
+    {
+	pcm_banks.rebase(prev_data, vgm_data.data());
+    }
+
+    compile_commands();
+    return true;
+}
+
+// Compiles whatever commands have been loaded so far
+void BeeVGMLoader::compile_commands()
+{
+    commands.compile_more(vgm_data.data(), vgm_data.size(), vgm_file.is_complete());
+
+    if (commands.has_invalid_blocks())
+    {
+	set_error(ErrorInvalidData, "VGM data has data blocks that are too small to hold their headers");
+    }
+}
+
+void BeeVGMLoader::check_end(size_t cmd_index)
+{
+    const BeeVGMCommand &cmd = commands.at(cmd_index);
+
+    if (cmd.type == CmdUnknown)
+    {
+	ostringstream msg;
+	msg << "Unrecognized VGM instruction of " << hex << int(cmd.data) << " at offset " << commands.get_offset(cmd_index);
+	set_error(ErrorUnknownCommand, msg.str());
+    }
+    else if ((cmd.type == CmdEnd) && commands.is_truncated())
+    {
+	set_error(ErrorTruncated, "VGM data ends without an end of stream command");
+    }
+}
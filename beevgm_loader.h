@@ -0,0 +1,151 @@
+/*
+    This file is part of the BeeVGM engine.
+    Copyright (C) 2022 BueniaDev.
+
+    BeeVGM is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    BeeVGM is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with BeeVGM.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// BeeVGM - VGM data loading
+//
+// Everything that comes straight from the loaded data, shared by the
+// engine and the event reader: opening (and decompressing) it, checking
+// the header, and compiling the commands as more of the data becomes
+// available. Nothing here throws on bad data; the first problem found
+// is kept instead (see get_error()).
+
+#ifndef BEEVGM_LOADER_H
+#define BEEVGM_LOADER_H
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <string>
+#include "beevgm_command.h"
+#include "beevgm_file.h"
+#include "beevgm_pcm.h"
+using namespace std;
+
+namespace beevgm
+{
+    // Problems found while loading or playing a file (see BeeVGM::getError)
+    enum BeeVGMError : int
+    {
+	ErrorNone = 0,
+	// The file couldn't be opened, or was empty
+	ErrorFileOpen,
+	// The data isn't VGM data (or its header is cut off)
+	ErrorInvalidData,
+	// The compressed data is damaged, so playback stops where the damage starts
+	ErrorDecompress,
+	// An opcode the spec doesn't define, so playback stops there
+	ErrorUnknownCommand,
+	// The data ends partway through a command, or without an end of stream command
+	ErrorTruncated,
+    };
+
+    class BeeVGMLoader
+    {
+	public:
+	    BeeVGMLoader();
+	    ~BeeVGMLoader();
+
+	    // These open the data like their counterparts in BeeVGMFile, and then
+	    // check the header and compile whatever commands are already there
+	    bool open(string filename);
+	    bool assign(vector<uint8_t> memory);
+	    bool borrow(const uint8_t *data, size_t size);
+	    // Also clears the error
+	    void close();
+
+	    // Decompresses (and compiles the commands in) the next chunk of a compressed file,
+	    // returning false once there's nothing left to load
+	    //
+	    // Data streams in 'pcm_banks' refer to blocks inside the data,
+	    // so they're moved along with it
+	    bool load_more(BeeVGMPCMBanks &pcm_banks);
+
+	    bool is_complete() const
+	    {
+		return vgm_file.is_complete();
+	    }
+
+	    BeeVGMSpan span() const
+	    {
+		return vgm_data;
+	    }
+
+	    const BeeVGMCommandStream &get_commands() const
+	    {
+		return commands;
+	    }
+
+	    uint32_t get_version() const
+	    {
+		return version;
+	    }
+
+	    // File offset of the first command
+	    uint32_t get_data_offset() const
+	    {
+		return data_offset;
+	    }
+
+	    // File offsets of the loop point and the GD3 tag (0 if there isn't one)
+	    uint32_t get_loop_offset() const
+	    {
+		return loop_offset;
+	    }
+
+	    uint32_t get_gd3_offset() const
+	    {
+		return gd3_offset;
+	    }
+
+	    // Reports why the commands stopped at 'cmd_index' (an unrecognized
+	    // opcode, or data that ran out), if it wasn't a proper end of stream
+	    void check_end(size_t cmd_index);
+
+	    // Only the first error is kept (and logged), since anything after it is usually just a knock-on effect
+	    BeeVGMError get_error() const
+	    {
+		return error_code;
+	    }
+
+	    const string &get_error_string() const
+	    {
+		return error_str;
+	    }
+
+	    void set_error(BeeVGMError error, string msg);
+
+	private:
+	    BeeVGMFile vgm_file;
+	    BeeVGMSpan vgm_data;
+	    BeeVGMCommandStream commands;
+
+	    uint32_t version = 0;
+	    uint32_t data_offset = 0;
+	    uint32_t loop_offset = 0;
+	    uint32_t gd3_offset = 0;
+
+	    BeeVGMError error_code = ErrorNone;
+	    string error_str;
+
+	    bool parse_header();
+	    void compile_commands();
+	    uint32_t read_long(uint32_t addr) const;
+    };
+};
+
+#endif // BEEVGM_LOADER_H
@@ -0,0 +1,99 @@
+/*
+    This file is part of the BeeVGM engine.
+    Copyright (C) 2022 BueniaDev.
+
+    BeeVGM is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    BeeVGM is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with BeeVGM.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <iostream>
+#include <mutex>
+#include <unordered_map>
+#include "beevgm_log.h"
+using namespace beevgm;
+using namespace std;
+
+atomic<int> BeeVGMLog::log_level(LogInfo);
+
+// Most distinct messages that are counted for rate limiting
+// (the counts start over once there are more than this)
+static constexpr size_t max_repeat_entries = 1024;
+
+struct BeeVGMLogState
+{
+    mutex log_mutex;
+    BeeVGMLog::sinkfunc sink;
+    unordered_map<string, uint32_t> repeat_counts;
+};
+
+static BeeVGMLogState &get_log_state()
+{
+    static BeeVGMLogState log_state;
+    return log_state;
+}
+
+void BeeVGMLog::set_sink(sinkfunc sink)
+{
+    auto &state = get_log_state();
+    lock_guard<mutex> lock(state.log_mutex);
+    state.sink = sink;
+}
+
+void BeeVGMLog::set_level(BeeVGMLogLevel level)
+{
+    log_level.store(level, memory_order_relaxed);
+}
+
+void BeeVGMLog::reset_repeats()
+{
+    auto &state = get_log_state();
+    lock_guard<mutex> lock(state.log_mutex);
+    state.repeat_counts.clear();
+}
+
+void BeeVGMLog::write(BeeVGMLogLevel level, const string &msg)
+{
+    auto &state = get_log_state();
+    lock_guard<mutex> lock(state.log_mutex);
+
+    bool is_last_repeat = false;
+
+    if (level >= LogWarning)
+    {
+	if (state.repeat_counts.size() >= max_repeat_entries)
+	{
+	    state.repeat_counts.clear();
+	}
+
+	uint32_t &repeat_count = state.repeat_counts[msg];
+
+	if (repeat_count >= max_repeats)
+	{
+	    return;
+	}
+
+	repeat_count += 1;
+	is_last_repeat = (repeat_count == max_repeats);
+    }
+
+    string final_msg = is_last_repeat ? (msg + " (repeated too often, further copies suppressed)") : msg;
+
+    if (state.sink)
+    {
+	state.sink(level, final_msg);
+    }
+    else
+    {
+	cout << final_msg << endl;
+    }
+}
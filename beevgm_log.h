@@ -0,0 +1,110 @@
+/*
+    This file is part of the BeeVGM engine.
+    Copyright (C) 2022 BueniaDev.
+
+    BeeVGM is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    BeeVGM is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with BeeVGM.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// BeeVGM - logging
+//
+// Messages are logged with BEEVGM_LOG(level, message), where the message
+// is written like the right-hand side of a stream insertion, i.e.
+//
+// BEEVGM_LOG(LogInfo, "Setting clock rate to " << dec << clock_rate << " Hz");
+//
+// Messages go to a sink, which prints them to stdout unless it's been
+// replaced with set_sink(). Levels below BEEVGM_LOG_LEVEL are compiled
+// out altogether, and levels below set_level() are dropped at runtime
+// before the message is even formatted.
+//
+// Warnings and errors are rate limited: once the same message has been
+// logged 'max_repeats' times, further copies of it are dropped, until
+// reset_repeats() is called. The counts are shared by every engine in
+// the process, so the engines leave that call up to the application.
+
+#ifndef BEEVGM_LOG_H
+#define BEEVGM_LOG_H
+
+#include <cstdint>
+#include <string>
+#include <sstream>
+#include <functional>
+#include <atomic>
+using namespace std;
+
+// Lowest level that's compiled in (0 = debug, 1 = info, 2 = warning, 3 = error, 4 = off)
+#ifndef BEEVGM_LOG_LEVEL
+#define BEEVGM_LOG_LEVEL 0
+#endif
+
+namespace beevgm
+{
+    enum BeeVGMLogLevel : int
+    {
+	LogDebug = 0,
+	LogInfo = 1,
+	LogWarning = 2,
+	LogError = 3,
+	LogOff = 4,
+    };
+
+    class BeeVGMLog
+    {
+	public:
+	    using sinkfunc = function<void(BeeVGMLogLevel, const string&)>;
+
+	    // Sends messages to 'sink' instead of stdout (or back to stdout, if 'sink' is empty)
+	    //
+	    // The sink is called with a lock held, so it's never called
+	    // from two threads at once, but it mustn't log anything itself
+	    static void set_sink(sinkfunc sink);
+
+	    // Drops messages below 'level' (LogInfo by default)
+	    static void set_level(BeeVGMLogLevel level);
+
+	    static BeeVGMLogLevel get_level()
+	    {
+		return BeeVGMLogLevel(log_level.load(memory_order_relaxed));
+	    }
+
+	    static bool is_enabled(BeeVGMLogLevel level)
+	    {
+		return (level >= log_level.load(memory_order_relaxed));
+	    }
+
+	    static void write(BeeVGMLogLevel level, const string &msg);
+
+	    static constexpr uint32_t max_repeats = 5;
+	    static void reset_repeats();
+
+	private:
+	    static atomic<int> log_level;
+    };
+};
+
+#define BEEVGM_LOG(level, msg) \
+    do \
+    { \
+	if constexpr (int(level) >= BEEVGM_LOG_LEVEL) \
+	{ \
+	    if (beevgm::BeeVGMLog::is_enabled(level)) \
+	    { \
+		std::ostringstream log_stream; \
+		log_stream << msg; \
+		beevgm::BeeVGMLog::write(level, log_stream.str()); \
+	    } \
+	} \
+    } while (0)
+
+#endif // BEEVGM_LOG_H
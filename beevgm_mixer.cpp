@@ -0,0 +1,229 @@
+/*
+    This file is part of the BeeVGM engine.
+    Copyright (C) 2022 BueniaDev.
+
+    BeeVGM is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    BeeVGM is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with BeeVGM.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include "beevgm_mixer.h"
+using namespace beevgm;
+using namespace std;
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define BEEVGM_MIXER_X86
+#include <immintrin.h>
+#endif
+
+static void add_scalar(int32_t *acc, const int32_t *samples, size_t num_frames)
+{
+    for (size_t i = 0; i < num_frames; i++)
+    {
+	acc[i] += samples[i];
+    }
+}
+
+static void output_scalar(int16_t *out, const int32_t *left, const int32_t *right, size_t num_frames)
+{
+    for (size_t i = 0; i < num_frames; i++)
+    {
+	out[(i * 2)] = clamp<int32_t>(left[i], -32768, 32767);
+	out[((i * 2) + 1)] = clamp<int32_t>(right[i], -32768, 32767);
+    }
+}
+
+#ifdef BEEVGM_MIXER_X86
+
+__attribute__((target("sse2")))
+static void add_sse2(int32_t *acc, const int32_t *samples, size_t num_frames)
+{
+    size_t i = 0;
+
+    for (; (i + 4) <= num_frames; i += 4)
+    {
+	__m128i acc_vec = _mm_loadu_si128((const __m128i*)&acc[i]);
+	__m128i sample_vec = _mm_loadu_si128((const __m128i*)&samples[i]);
+	_mm_storeu_si128((__m128i*)&acc[i], _mm_add_epi32(acc_vec, sample_vec));
+    }
+
+    add_scalar(&acc[i], &samples[i], (num_frames - i));
+}
+
+// _mm_packs_epi32 saturates to 16 bits for us, so interleaving
+// and clamping both come for free
+__attribute__((target("sse2")))
+static void output_sse2(int16_t *out, const int32_t *left, const int32_t *right, size_t num_frames)
+{
+    size_t i = 0;
+
+    for (; (i + 4) <= num_frames; i += 4)
+    {
+	__m128i left_vec = _mm_loadu_si128((const __m128i*)&left[i]);
+	__m128i right_vec = _mm_loadu_si128((const __m128i*)&right[i]);
+	__m128i lo_vec = _mm_unpacklo_epi32(left_vec, right_vec);
+	__m128i hi_vec = _mm_unpackhi_epi32(left_vec, right_vec);
+	_mm_storeu_si128((__m128i*)&out[(i * 2)], _mm_packs_epi32(lo_vec, hi_vec));
+    }
+
+    output_scalar(&out[(i * 2)], &left[i], &right[i], (num_frames - i));
+}
+
+__attribute__((target("avx2")))
+static void add_avx2(int32_t *acc, const int32_t *samples, size_t num_frames)
+{
+    size_t i = 0;
+
+    for (; (i + 8) <= num_frames; i += 8)
+    {
+	__m256i acc_vec = _mm256_loadu_si256((const __m256i*)&acc[i]);
+	__m256i sample_vec = _mm256_loadu_si256((const __m256i*)&samples[i]);
+	_mm256_storeu_si256((__m256i*)&acc[i], _mm256_add_epi32(acc_vec, sample_vec));
+    }
+
+    add_scalar(&acc[i], &samples[i], (num_frames - i));
+}
+
+// The AVX2 unpack and pack instructions both work within 128-bit lanes,
+// which conveniently cancels out, so the frames come out in order
+__attribute__((target("avx2")))
+static void output_avx2(int16_t *out, const int32_t *left, const int32_t *right, size_t num_frames)
+{
+    size_t i = 0;
+
+    for (; (i + 8) <= num_frames; i += 8)
+    {
+	__m256i left_vec = _mm256_loadu_si256((const __m256i*)&left[i]);
+	__m256i right_vec = _mm256_loadu_si256((const __m256i*)&right[i]);
+	__m256i lo_vec = _mm256_unpacklo_epi32(left_vec, right_vec);
+	__m256i hi_vec = _mm256_unpackhi_epi32(left_vec, right_vec);
+	_mm256_storeu_si256((__m256i*)&out[(i * 2)], _mm256_packs_epi32(lo_vec, hi_vec));
+    }
+
+    output_scalar(&out[(i * 2)], &left[i], &right[i], (num_frames - i));
+}
+
+#endif // BEEVGM_MIXER_X86
+
+BeeVGMMixer::BeeVGMMixer()
+{
+    set_isa(detect_isa());
+}
+
+BeeVGMMixer::~BeeVGMMixer()
+{
+
+}
+
+bool BeeVGMMixer::is_isa_supported(BeeVGMMixerISA isa)
+{
+    switch (isa)
+    {
+	case MixerScalar: return true;
+#ifdef BEEVGM_MIXER_X86
+	case MixerSSE2: return __builtin_cpu_supports("sse2");
+	case MixerAVX2: return __builtin_cpu_supports("avx2");
+#endif
+	default: return false;
+    }
+}
+
+BeeVGMMixerISA BeeVGMMixer::detect_isa()
+{
+    if (is_isa_supported(MixerAVX2))
+    {
+	return MixerAVX2;
+    }
+    else if (is_isa_supported(MixerSSE2))
+    {
+	return MixerSSE2;
+    }
+    else
+    {
+	return MixerScalar;
+    }
+}
+
+bool BeeVGMMixer::set_isa(BeeVGMMixerISA isa)
+{
+    if (!is_isa_supported(isa))
+    {
+	return false;
+    }
+
+    mixer_isa = isa;
+
+    switch (isa)
+    {
+#ifdef BEEVGM_MIXER_X86
+	case MixerSSE2:
+	{
+	    add_samples = add_sse2;
+	    output_samples = output_sse2;
+	}
+	break;
+	case MixerAVX2:
+	{
+	    add_samples = add_avx2;
+	    output_samples = output_avx2;
+	}
+	break;
+#endif
+	default:
+	{
+	    add_samples = add_scalar;
+	    output_samples = output_scalar;
+	}
+	break;
+    }
+
+    return true;
+}
+
+BeeVGMMixerISA BeeVGMMixer::get_isa()
+{
+    return mixer_isa;
+}
+
+string BeeVGMMixer::get_isa_name()
+{
+    switch (mixer_isa)
+    {
+	case MixerSSE2: return "SSE2";
+	case MixerAVX2: return "AVX2";
+	default: return "Scalar";
+    }
+}
+
+void BeeVGMMixer::clear(size_t num_frames)
+{
+    if (acc_left.size() < num_frames)
+    {
+	acc_left.resize(num_frames);
+	acc_right.resize(num_frames);
+    }
+
+    fill_n(acc_left.begin(), num_frames, 0);
+    fill_n(acc_right.begin(), num_frames, 0);
+}
+
+void BeeVGMMixer::add(const int32_t *left, const int32_t *right, size_t num_frames)
+{
+    add_samples(acc_left.data(), left, num_frames);
+    add_samples(acc_right.data(), right, num_frames);
+}
+
+void BeeVGMMixer::output(int16_t *out, size_t num_frames)
+{
+    output_samples(out, acc_left.data(), acc_right.data(), num_frames);
+}
@@ -0,0 +1,80 @@
+/*
+    This file is part of the BeeVGM engine.
+    Copyright (C) 2022 BueniaDev.
+
+    BeeVGM is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    BeeVGM is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with BeeVGM.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// BeeVGM - output mixer
+//
+// Chip output is summed into planar 32-bit accumulators, and only
+// saturated to 16 bits once, when the block is interleaved into
+// the output buffer.
+//
+// The SSE2 and AVX2 versions of the mixing loops are picked at runtime
+// on x86 (GCC and Clang only for now), with a scalar fallback everywhere else.
+
+#ifndef BEEVGM_MIXER_H
+#define BEEVGM_MIXER_H
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <string>
+using namespace std;
+
+namespace beevgm
+{
+    enum BeeVGMMixerISA
+    {
+	MixerScalar = 0,
+	MixerSSE2 = 1,
+	MixerAVX2 = 2,
+    };
+
+    class BeeVGMMixer
+    {
+	public:
+	    BeeVGMMixer();
+	    ~BeeVGMMixer();
+
+	    // Clears the accumulators for a new block of 'num_frames' frames
+	    void clear(size_t num_frames);
+	    // Adds a block of planar chip output to the accumulators
+	    void add(const int32_t *left, const int32_t *right, size_t num_frames);
+	    // Saturates the accumulators to 16 bits and interleaves them into 'out'
+	    void output(int16_t *out, size_t num_frames);
+
+	    BeeVGMMixerISA get_isa();
+	    bool set_isa(BeeVGMMixerISA isa);
+	    string get_isa_name();
+
+	    static bool is_isa_supported(BeeVGMMixerISA isa);
+	    static BeeVGMMixerISA detect_isa();
+
+	private:
+	    vector<int32_t> acc_left;
+	    vector<int32_t> acc_right;
+
+	    BeeVGMMixerISA mixer_isa = MixerScalar;
+
+	    using add_func = void (*)(int32_t*, const int32_t*, size_t);
+	    using output_func = void (*)(int16_t*, const int32_t*, const int32_t*, size_t);
+
+	    add_func add_samples = nullptr;
+	    output_func output_samples = nullptr;
+    };
+};
+
+#endif // BEEVGM_MIXER_H
@@ -0,0 +1,431 @@
+/*
+    This file is part of the BeeVGM engine.
+    Copyright (C) 2022 BueniaDev.
+
+    BeeVGM is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    BeeVGM is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with BeeVGM.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include "beevgm_pcm.h"
+#include "beevgm_log.h"
+using namespace beevgm;
+using namespace std;
+
+BeeVGMPCMBank::BeeVGMPCMBank()
+{
+
+}
+
+BeeVGMPCMBank::~BeeVGMPCMBank()
+{
+
+}
+
+void BeeVGMPCMBank::clear()
+{
+    bank_span = BeeVGMSpan();
+    bank_data.clear();
+    bank_blocks.clear();
+}
+
+void BeeVGMPCMBank::add_block(BeeVGMSpan block)
+{
+    add_block_info(block.size());
+
+    // The first block can be used right where it is
+    if (bank_span.empty())
+    {
+	bank_span = block;
+	return;
+    }
+
+    append_data(block.data(), block.size());
+}
+
+void BeeVGMPCMBank::append(const uint8_t *data, size_t size)
+{
+    add_block_info(size);
+    append_data(data, size);
+}
+
+void BeeVGMPCMBank::add_block_info(size_t size)
+{
+    BeeVGMPCMBlock block;
+    block.offset = uint32_t(bank_span.size());
+    block.size = uint32_t(size);
+    bank_blocks.push_back(block);
+}
+
+void BeeVGMPCMBank::append_data(const uint8_t *data, size_t size)
+{
+    make_owned(size);
+    bank_data.insert(bank_data.end(), data, (data + size));
+    bank_span = BeeVGMSpan(bank_data.data(), bank_data.size());
+}
+
+// Moves the bank into storage of its own (if it isn't there already),
+// with room for at least 'extra_size' more bytes
+void BeeVGMPCMBank::make_owned(size_t extra_size)
+{
+    bool is_owned = (bank_span.data() == bank_data.data());
+
+    if (!is_owned)
+    {
+	bank_data.assign(bank_span.data(), (bank_span.data() + bank_span.size()));
+    }
+
+    size_t new_size = (bank_data.size() + extra_size);
+
+    if (new_size > bank_data.capacity())
+    {
+	bank_data.reserve(max(new_size, (bank_data.capacity() * 2)));
+    }
+}
+
+void BeeVGMPCMBank::truncate(size_t num_blocks)
+{
+    if (num_blocks >= bank_blocks.size())
+    {
+	return;
+    }
+
+    if (num_blocks == 0)
+    {
+	clear();
+	return;
+    }
+
+    const BeeVGMPCMBlock &last_block = bank_blocks[(num_blocks - 1)];
+    size_t new_size = (last_block.offset + last_block.size);
+    bank_blocks.resize(num_blocks);
+
+    bool is_owned = (bank_span.data() == bank_data.data());
+
+    if (is_owned)
+    {
+	bank_data.resize(new_size);
+    }
+
+    bank_span = BeeVGMSpan(bank_span.data(), new_size);
+}
+
+BeeVGMSpan BeeVGMPCMBank::read_span(size_t pos, size_t size) const
+{
+    if (pos >= bank_span.size())
+    {
+	return BeeVGMSpan();
+    }
+
+    size_t length = min(size, (bank_span.size() - pos));
+    return BeeVGMSpan((bank_span.data() + pos), length);
+}
+
+void BeeVGMPCMBank::rebase(BeeVGMSpan old_data, const uint8_t *new_data)
+{
+    const uint8_t *bank_ptr = bank_span.data();
+    const uint8_t *old_begin = old_data.data();
+    const uint8_t *old_end = (old_begin + old_data.size());
+
+    if ((bank_ptr == nullptr) || (bank_ptr == bank_data.data()))
+    {
+	return;
+    }
+
+    if ((bank_ptr >= old_begin) && (bank_ptr < old_end))
+    {
+	bank_span = BeeVGMSpan((new_data + (bank_ptr - old_begin)), bank_span.size());
+    }
+}
+
+uint8_t *BeeVGMPCMBank::extend(size_t size)
+{
+    add_block_info(size);
+    make_owned(size);
+
+    size_t block_pos = bank_data.size();
+    bank_data.resize((block_pos + size), 0);
+    bank_span = BeeVGMSpan(bank_data.data(), bank_data.size());
+    return (bank_data.data() + block_pos);
+}
+
+// Reads 'num_values' values of 'num_bits' bits each (most significant bit first),
+// passing each one to 'func'
+//
+// Values over 8 bits are packed as 8-bit chunks, the first of which holds
+// the low 8 bits (as in the reference decoder), so those are put back together
+//
+// Up to 7 bytes are loaded into the bit buffer at a time, so each value
+// only takes a shift and a mask (and a refill once every few values)
+template<typename Func>
+static void unpack_bits(BeeVGMSpan data, size_t num_values, uint8_t num_bits, Func func)
+{
+    const uint8_t *src = data.data();
+    const uint8_t *src_end = (src + data.size());
+
+    uint64_t bit_buf = 0;
+    int bit_count = 0;
+    uint32_t value_mask = ((1 << num_bits) - 1);
+    int high_bits = max((num_bits - 8), 0);
+    uint32_t high_mask = ((1 << high_bits) - 1);
+
+    for (size_t index = 0; index < num_values; index++)
+    {
+	if (bit_count < num_bits)
+	{
+	    while (bit_count <= 48)
+	    {
+		uint8_t next_byte = (src < src_end) ? *src++ : 0;
+		bit_buf = ((bit_buf << 8) | next_byte);
+		bit_count += 8;
+	    }
+	}
+
+	bit_count -= num_bits;
+	uint32_t value = uint32_t((bit_buf >> bit_count) & value_mask);
+
+	if (high_bits != 0)
+	{
+	    value = ((value >> high_bits) | ((value & high_mask) << 8));
+	}
+
+	func(index, value);
+    }
+}
+
+template<typename Func>
+static void write_values(uint8_t *out, size_t num_values, int out_bytes, BeeVGMSpan data, uint8_t num_bits, Func func)
+{
+    if (out_bytes == 1)
+    {
+	unpack_bits(data, num_values, num_bits, [&](size_t index, uint32_t value) {
+	    out[index] = uint8_t(func(value));
+	});
+    }
+    else
+    {
+	unpack_bits(data, num_values, num_bits, [&](size_t index, uint32_t value) {
+	    uint16_t out_val = func(value);
+	    out[(index * 2)] = (out_val & 0xFF);
+	    out[((index * 2) + 1)] = (out_val >> 8);
+	});
+    }
+}
+
+bool BeeVGMPCMBanks::set_table(BeeVGMSpan block)
+{
+    if (block.size() < 6)
+    {
+	BEEVGM_LOG(LogWarning, "Invalid decompression table");
+	return false;
+    }
+
+    BeeVGMPCMTable table;
+    table.comp_type = block[0];
+    table.sub_type = block[1];
+    table.bits_dec = block[2];
+    table.bits_comp = block[3];
+    uint16_t num_values = (block[4] | (block[5] << 8));
+
+    size_t value_size = ((table.bits_dec + 7) / 8);
+
+    if ((value_size == 0) || (value_size > 2) || (block.size() < (6 + (num_values * value_size))))
+    {
+	BEEVGM_LOG(LogWarning, "Invalid decompression table");
+	return false;
+    }
+
+    table.values.resize(num_values, 0);
+
+    for (size_t index = 0; index < num_values; index++)
+    {
+	size_t value_pos = (6 + (index * value_size));
+	uint16_t value = block[value_pos];
+
+	if (value_size == 2)
+	{
+	    value |= (block[(value_pos + 1)] << 8);
+	}
+
+	table.values[index] = value;
+    }
+
+    comp_table = move(table);
+    return true;
+}
+
+bool BeeVGMPCMBanks::is_table_valid(uint8_t comp_type, uint8_t sub_type, uint8_t bits_dec, uint8_t bits_comp) const
+{
+    if ((comp_table.comp_type != comp_type) || (comp_table.sub_type != sub_type))
+    {
+	return false;
+    }
+
+    if ((comp_table.bits_dec != bits_dec) || (comp_table.bits_comp != bits_comp))
+    {
+	return false;
+    }
+
+    // The table can hold any number of entries (values past the end are looked up as 0)
+    return true;
+}
+
+void BeeVGMPCMBanks::add_stream_block(uint8_t data_type, BeeVGMSpan block)
+{
+    uint8_t bank_type = (data_type & 0x3F);
+
+    switch (data_type & 0xC0)
+    {
+	// Uncompressed data streams
+	case 0x00: pcm_banks[bank_type].add_block(block); break;
+	// Compressed data streams (and the decompression table)
+	case 0x40:
+	{
+	    if (data_type == 0x7F)
+	    {
+		set_table(block);
+	    }
+	    else
+	    {
+		add_compressed_block(bank_type, block);
+	    }
+	}
+	break;
+	default: break;
+    }
+}
+
+bool BeeVGMPCMBanks::add_compressed_block(size_t bank_type, BeeVGMSpan block)
+{
+    if (block.size() < 10)
+    {
+	BEEVGM_LOG(LogWarning, "Invalid compressed data block");
+	return false;
+    }
+
+    uint8_t comp_type = block[0];
+    uint32_t out_size = (block[1] | (block[2] << 8) | (block[3] << 16) | (block[4] << 24));
+    uint8_t bits_dec = block[5];
+    uint8_t bits_comp = block[6];
+    uint8_t sub_type = block[7];
+    uint16_t add_val = (block[8] | (block[9] << 8));
+
+    if ((bits_dec == 0) || (bits_dec > 16) || (bits_comp == 0) || (bits_comp > 16))
+    {
+	BEEVGM_LOG(LogWarning, "Unsupported compression bit sizes of " << dec << int(bits_dec) << " and " << int(bits_comp));
+	return false;
+    }
+
+    BeeVGMSpan data = block.subspan(10, (block.size() - 10));
+
+    // Catch sizes that can't possibly come from this much data,
+    // before allocating room for them
+    size_t num_values = (out_size / ((bits_dec + 7) / 8));
+
+    if (num_values > (((data.size() * 8) / bits_comp) + 1))
+    {
+	BEEVGM_LOG(LogWarning, "Compressed data block is too short");
+	return false;
+    }
+
+    switch (comp_type)
+    {
+	case 0x00: return decompress_nbit(bank_type, data, out_size, bits_dec, bits_comp, sub_type, add_val);
+	case 0x01: return decompress_dpcm(bank_type, data, out_size, bits_dec, bits_comp, sub_type, add_val);
+	default: BEEVGM_LOG(LogWarning, "Unrecognized compression type of " << hex << int(comp_type)); break;
+    }
+
+    return false;
+}
+
+// n-bit compression, where each value is copied, shifted left or looked up in the table
+bool BeeVGMPCMBanks::decompress_nbit(size_t bank_type, BeeVGMSpan data, uint32_t out_size, uint8_t bits_dec, uint8_t bits_comp, uint8_t sub_type, uint16_t add_val)
+{
+    if ((sub_type == 0x02) && !is_table_valid(0x00, sub_type, bits_dec, bits_comp))
+    {
+	BEEVGM_LOG(LogWarning, "Missing decompression table for n-bit compressed data");
+	return false;
+    }
+
+    int out_bytes = ((bits_dec + 7) / 8);
+    size_t num_values = (out_size / out_bytes);
+    uint8_t *out = pcm_banks.at(bank_type).extend(out_size);
+
+    switch (sub_type)
+    {
+	// Copy
+	case 0x00:
+	{
+	    write_values(out, num_values, out_bytes, data, bits_comp, [&](uint32_t value) -> uint16_t {
+		return (value + add_val);
+	    });
+	}
+	break;
+	// Shift left
+	case 0x01:
+	{
+	    int shift = max((bits_dec - bits_comp), 0);
+
+	    write_values(out, num_values, out_bytes, data, bits_comp, [&](uint32_t value) -> uint16_t {
+		return ((value << shift) + add_val);
+	    });
+	}
+	break;
+	// Table
+	case 0x02:
+	{
+	    const uint16_t *table = comp_table.values.data();
+	    size_t table_size = comp_table.values.size();
+
+	    write_values(out, num_values, out_bytes, data, bits_comp, [&](uint32_t value) -> uint16_t {
+		return (value < table_size) ? table[value] : 0;
+	    });
+	}
+	break;
+	default:
+	{
+	    BEEVGM_LOG(LogWarning, "Unrecognized n-bit compression sub-type of " << hex << int(sub_type));
+	    return false;
+	}
+	break;
+    }
+
+    return true;
+}
+
+// DPCM compression, where each value is looked up in the table and added to the last one
+bool BeeVGMPCMBanks::decompress_dpcm(size_t bank_type, BeeVGMSpan data, uint32_t out_size, uint8_t bits_dec, uint8_t bits_comp, uint8_t sub_type, uint16_t start_val)
+{
+    if (!is_table_valid(0x01, sub_type, bits_dec, bits_comp))
+    {
+	BEEVGM_LOG(LogWarning, "Missing decompression table for DPCM compressed data");
+	return false;
+    }
+
+    int out_bytes = ((bits_dec + 7) / 8);
+    size_t num_values = (out_size / out_bytes);
+    uint8_t *out = pcm_banks.at(bank_type).extend(out_size);
+
+    const uint16_t *table = comp_table.values.data();
+    size_t table_size = comp_table.values.size();
+    uint16_t out_mask = uint16_t((1 << bits_dec) - 1);
+    uint16_t out_val = start_val;
+
+    write_values(out, num_values, out_bytes, data, bits_comp, [&](uint32_t value) -> uint16_t {
+	uint16_t delta = (value < table_size) ? table[value] : 0;
+	out_val = ((out_val + delta) & out_mask);
+	return out_val;
+    });
+
+    return true;
+}
@@ -0,0 +1,236 @@
+/*
+    This file is part of the BeeVGM engine.
+    Copyright (C) 2022 BueniaDev.
+
+    BeeVGM is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    BeeVGM is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with BeeVGM.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// BeeVGM - PCM data banks
+//
+// Each of the 0x40 data block types (command 0x67, types 0x00-0x3F) gets
+// its own bank. A bank made of a single block refers to that block
+// directly inside the loaded VGM data; further blocks are appended in
+// place to storage owned by the bank, so adding a block never copies
+// the rest of the bank again.
+//
+// Compressed blocks (types 0x40-0x7E) are decompressed once, straight
+// into their bank, using the last decompression table (type 0x7F) seen.
+
+#ifndef BEEVGM_PCM_H
+#define BEEVGM_PCM_H
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <array>
+#include "beevgm_file.h"
+using namespace std;
+
+namespace beevgm
+{
+    // Where each data block was placed in its bank (used by command 0x95)
+    struct BeeVGMPCMBlock
+    {
+	uint32_t offset = 0;
+	uint32_t size = 0;
+    };
+
+    class BeeVGMPCMBank
+    {
+	public:
+	    BeeVGMPCMBank();
+	    ~BeeVGMPCMBank();
+
+	    // Adds a block that lives in memory outliving the bank (i.e. the loaded VGM data)
+	    void add_block(BeeVGMSpan block);
+	    // Adds a block from temporary memory
+	    void append(const uint8_t *data, size_t size);
+	    // Adds an empty block of 'size' bytes and returns where to write its contents
+	    // (i.e. for decompressing data straight into the bank)
+	    uint8_t *extend(size_t size);
+	    void clear();
+
+	    size_t size() const
+	    {
+		return bank_span.size();
+	    }
+
+	    bool empty() const
+	    {
+		return bank_span.empty();
+	    }
+
+	    // The returned pointers stay valid until the next block is added to the bank
+	    const uint8_t *data() const
+	    {
+		return bank_span.data();
+	    }
+
+	    BeeVGMSpan span() const
+	    {
+		return bank_span;
+	    }
+
+	    bool is_valid(size_t pos) const
+	    {
+		return (pos < bank_span.size());
+	    }
+
+	    uint8_t read(size_t pos) const
+	    {
+		return bank_span[pos];
+	    }
+
+	    // Returns up to 'size' bytes starting at 'pos', cut short at the end of the bank
+	    BeeVGMSpan read_span(size_t pos, size_t size) const;
+
+	    // Drops every block after the first 'num_blocks' (i.e. to go back to an earlier point in playback)
+	    void truncate(size_t num_blocks);
+
+	    // Points a bank that refers to a block inside 'old_data' at the same block inside 'new_data'
+	    void rebase(BeeVGMSpan old_data, const uint8_t *new_data);
+
+	    size_t num_blocks() const
+	    {
+		return bank_blocks.size();
+	    }
+
+	    bool is_block_valid(size_t block_id) const
+	    {
+		return (block_id < bank_blocks.size());
+	    }
+
+	    const BeeVGMPCMBlock &get_block(size_t block_id) const
+	    {
+		return bank_blocks.at(block_id);
+	    }
+
+	private:
+	    BeeVGMSpan bank_span;
+	    vector<uint8_t> bank_data;
+	    vector<BeeVGMPCMBlock> bank_blocks;
+
+	    void add_block_info(size_t size);
+	    void append_data(const uint8_t *data, size_t size);
+	    void make_owned(size_t extra_size);
+    };
+
+    // Decompression table (data block type 0x7F)
+    struct BeeVGMPCMTable
+    {
+	uint8_t comp_type = 0;
+	uint8_t sub_type = 0;
+	uint8_t bits_dec = 0;
+	uint8_t bits_comp = 0;
+	vector<uint16_t> values;
+    };
+
+    // How far along every bank was at some point in playback (see BeeVGMPCMBanks::rewind)
+    struct BeeVGMPCMMark
+    {
+	array<uint32_t, 0x40> num_blocks;
+	BeeVGMPCMTable comp_table;
+    };
+
+    class BeeVGMPCMBanks
+    {
+	public:
+	    BeeVGMPCMBanks()
+	    {
+
+	    }
+
+	    ~BeeVGMPCMBanks()
+	    {
+
+	    }
+
+	    static constexpr size_t num_banks = 0x40;
+
+	    BeeVGMPCMBank &at(size_t bank_type)
+	    {
+		return pcm_banks.at(bank_type);
+	    }
+
+	    const BeeVGMPCMBank &at(size_t bank_type) const
+	    {
+		return pcm_banks.at(bank_type);
+	    }
+
+	    BeeVGMPCMBank &operator [](size_t bank_type)
+	    {
+		return at(bank_type);
+	    }
+
+	    void clear()
+	    {
+		for (auto &bank : pcm_banks)
+		{
+		    bank.clear();
+		}
+
+		comp_table = BeeVGMPCMTable();
+	    }
+
+	    void rebase(BeeVGMSpan old_data, const uint8_t *new_data)
+	    {
+		for (auto &bank : pcm_banks)
+		{
+		    bank.rebase(old_data, new_data);
+		}
+	    }
+
+	    BeeVGMPCMMark get_mark() const
+	    {
+		BeeVGMPCMMark mark;
+
+		for (size_t bank_type = 0; bank_type < num_banks; bank_type++)
+		{
+		    mark.num_blocks[bank_type] = uint32_t(pcm_banks[bank_type].num_blocks());
+		}
+
+		mark.comp_table = comp_table;
+		return mark;
+	    }
+
+	    // Goes back to an earlier mark, dropping every block added since
+	    void rewind(const BeeVGMPCMMark &mark)
+	    {
+		for (size_t bank_type = 0; bank_type < num_banks; bank_type++)
+		{
+		    pcm_banks[bank_type].truncate(mark.num_blocks[bank_type]);
+		}
+
+		comp_table = mark.comp_table;
+	    }
+
+	    // Adds the contents of a data stream block (types 0x00-0x7F) to its bank
+	    void add_stream_block(uint8_t data_type, BeeVGMSpan block);
+	    // Decompresses a block (the contents of a type 0x40-0x7E data block)
+	    // into bank 'bank_type'
+	    bool add_compressed_block(size_t bank_type, BeeVGMSpan block);
+	    // Sets the decompression table (the contents of a type 0x7F data block)
+	    bool set_table(BeeVGMSpan block);
+
+	private:
+	    array<BeeVGMPCMBank, num_banks> pcm_banks;
+	    BeeVGMPCMTable comp_table;
+
+	    bool decompress_nbit(size_t bank_type, BeeVGMSpan data, uint32_t out_size, uint8_t bits_dec, uint8_t bits_comp, uint8_t sub_type, uint16_t add_val);
+	    bool decompress_dpcm(size_t bank_type, BeeVGMSpan data, uint32_t out_size, uint8_t bits_dec, uint8_t bits_comp, uint8_t sub_type, uint16_t start_val);
+	    bool is_table_valid(uint8_t comp_type, uint8_t sub_type, uint8_t bits_dec, uint8_t bits_comp) const;
+    };
+};
+
+#endif // BEEVGM_PCM_H
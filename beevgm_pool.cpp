@@ -0,0 +1,247 @@
+/*
+    This file is part of the BeeVGM engine.
+    Copyright (C) 2022 BueniaDev.
+
+    BeeVGM is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    BeeVGM is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with BeeVGM.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include "beevgm_pool.h"
+#include "beevgm.h"
+using namespace beevgm;
+using namespace std;
+
+namespace beevgm
+{
+    // Shared with the engines handed out, so they can still be returned
+    // (or at least safely deleted) if the pool's gone by then
+    struct BeeVGMEngineList
+    {
+	mutex list_mutex;
+	vector<unique_ptr<BeeVGM>> engines;
+	size_t max_idle = 0;
+    };
+};
+
+BeeVGMThreadPool::BeeVGMThreadPool(size_t num_threads) : next_queue(0)
+{
+    if (num_threads == 0)
+    {
+	num_threads = default_threads();
+    }
+
+    for (size_t index = 0; index < num_threads; index++)
+    {
+	queues.push_back(make_unique<BeeVGMWorkQueue>());
+    }
+
+    for (size_t index = 0; index < num_threads; index++)
+    {
+	workers.emplace_back(&BeeVGMThreadPool::run_worker, this, index);
+    }
+}
+
+BeeVGMThreadPool::~BeeVGMThreadPool()
+{
+    {
+	lock_guard<mutex> lock(pool_mutex);
+	is_stopping = true;
+    }
+
+    work_cond.notify_all();
+
+    for (auto &worker : workers)
+    {
+	worker.join();
+    }
+}
+
+size_t BeeVGMThreadPool::default_threads()
+{
+    return max<size_t>(thread::hardware_concurrency(), 1);
+}
+
+void BeeVGMThreadPool::submit(taskfunc task)
+{
+    size_t queue_id = (next_queue++ % queues.size());
+
+    // Counted before it's queued, so a worker can't finish it first
+    {
+	lock_guard<mutex> lock(pool_mutex);
+	num_queued += 1;
+	num_pending += 1;
+    }
+
+    {
+	lock_guard<mutex> lock(queues[queue_id]->queue_mutex);
+	queues[queue_id]->tasks.push_back(move(task));
+    }
+
+    work_cond.notify_one();
+}
+
+void BeeVGMThreadPool::wait()
+{
+    unique_lock<mutex> lock(pool_mutex);
+    done_cond.wait(lock, [&] {
+	return (num_pending == 0);
+    });
+}
+
+// Takes the next task from the front of this worker's queue,
+// or failing that, from the back of another worker's queue
+bool BeeVGMThreadPool::pop_task(size_t worker_id, taskfunc &task)
+{
+    size_t num_queues = queues.size();
+
+    for (size_t offset = 0; offset < num_queues; offset++)
+    {
+	auto &queue = *queues[((worker_id + offset) % num_queues)];
+	lock_guard<mutex> lock(queue.queue_mutex);
+
+	if (queue.tasks.empty())
+	{
+	    continue;
+	}
+
+	if (offset == 0)
+	{
+	    task = move(queue.tasks.front());
+	    queue.tasks.pop_front();
+	}
+	else
+	{
+	    task = move(queue.tasks.back());
+	    queue.tasks.pop_back();
+	}
+
+	return true;
+    }
+
+    return false;
+}
+
+void BeeVGMThreadPool::run_worker(size_t worker_id)
+{
+    while (true)
+    {
+	taskfunc task;
+
+	if (pop_task(worker_id, task))
+	{
+	    {
+		lock_guard<mutex> lock(pool_mutex);
+		num_queued -= 1;
+	    }
+
+	    task(worker_id);
+
+	    bool is_done = false;
+
+	    {
+		lock_guard<mutex> lock(pool_mutex);
+		num_pending -= 1;
+		is_done = (num_pending == 0);
+	    }
+
+	    if (is_done)
+	    {
+		done_cond.notify_all();
+	    }
+
+	    continue;
+	}
+
+	unique_lock<mutex> lock(pool_mutex);
+	work_cond.wait(lock, [&] {
+	    return (is_stopping || (num_queued != 0));
+	});
+
+	if (is_stopping && (num_queued == 0))
+	{
+	    return;
+	}
+    }
+}
+
+BeeVGMEnginePool::BeeVGMEnginePool(size_t max_idle) : engine_list(make_shared<BeeVGMEngineList>())
+{
+    engine_list->max_idle = max_idle;
+}
+
+BeeVGMEnginePool::~BeeVGMEnginePool()
+{
+
+}
+
+BeeVGMEnginePool::engineptr BeeVGMEnginePool::acquire()
+{
+    unique_ptr<BeeVGM> engine;
+
+    {
+	lock_guard<mutex> lock(engine_list->list_mutex);
+
+	if (!engine_list->engines.empty())
+	{
+	    engine = move(engine_list->engines.back());
+	    engine_list->engines.pop_back();
+	}
+    }
+
+    // New engines are created outside the lock, so other threads aren't held up
+    if (engine == nullptr)
+    {
+	engine = make_unique<BeeVGM>();
+    }
+
+    return engineptr(engine.release(), BeeVGMEngineReturn{engine_list});
+}
+
+void BeeVGMEnginePool::reserve(size_t num_engines)
+{
+    while (num_idle() < num_engines)
+    {
+	auto engine = make_unique<BeeVGM>();
+
+	lock_guard<mutex> lock(engine_list->list_mutex);
+	engine_list->engines.push_back(move(engine));
+    }
+}
+
+size_t BeeVGMEnginePool::num_idle()
+{
+    lock_guard<mutex> lock(engine_list->list_mutex);
+    return engine_list->engines.size();
+}
+
+void BeeVGMEnginePool::BeeVGMEngineReturn::operator()(BeeVGM *engine) const
+{
+    unique_ptr<BeeVGM> returned(engine);
+    auto list = engine_list.lock();
+
+    if (list == nullptr)
+    {
+	return;
+    }
+
+    // Unloading the file is done outside the lock too
+    returned->reset();
+
+    lock_guard<mutex> lock(list->list_mutex);
+
+    if ((list->max_idle == 0) || (list->engines.size() < list->max_idle))
+    {
+	list->engines.push_back(move(returned));
+    }
+}
@@ -0,0 +1,132 @@
+/*
+    This file is part of the BeeVGM engine.
+    Copyright (C) 2022 BueniaDev.
+
+    BeeVGM is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    BeeVGM is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with BeeVGM.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// BeeVGM - work-stealing thread pool
+//
+// Each worker has a queue of its own, and new tasks are spread across
+// them in turn. A worker runs tasks from the front of its own queue,
+// and once that's empty, steals from the back of the other ones, so
+// a few long tasks can't leave the rest of the workers sitting idle.
+//
+// Tasks are passed the index of the worker running them, which can be
+// used to keep per-worker state (i.e. one BeeVGM instance per worker).
+//
+// For engines shared between threads that aren't the pool's own, there's
+// also BeeVGMEnginePool, which keeps engines that are done with around
+// for the next caller, instead of constructing a new one every time.
+
+#ifndef BEEVGM_POOL_H
+#define BEEVGM_POOL_H
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+using namespace std;
+
+namespace beevgm
+{
+    class BeeVGMThreadPool
+    {
+	public:
+	    using taskfunc = function<void(size_t)>;
+
+	    // 0 threads means one per hardware thread
+	    BeeVGMThreadPool(size_t num_threads = 0);
+	    ~BeeVGMThreadPool();
+
+	    BeeVGMThreadPool(const BeeVGMThreadPool&) = delete;
+	    BeeVGMThreadPool &operator=(const BeeVGMThreadPool&) = delete;
+
+	    void submit(taskfunc task);
+	    // Waits until every task submitted so far has finished
+	    void wait();
+
+	    size_t num_threads() const
+	    {
+		return workers.size();
+	    }
+
+	    static size_t default_threads();
+
+	private:
+	    struct BeeVGMWorkQueue
+	    {
+		mutex queue_mutex;
+		deque<taskfunc> tasks;
+	    };
+
+	    vector<thread> workers;
+	    vector<unique_ptr<BeeVGMWorkQueue>> queues;
+
+	    mutex pool_mutex;
+	    condition_variable work_cond;
+	    condition_variable done_cond;
+
+	    atomic<size_t> next_queue;
+	    size_t num_queued = 0;
+	    size_t num_pending = 0;
+	    bool is_stopping = false;
+
+	    void run_worker(size_t worker_id);
+	    bool pop_task(size_t worker_id, taskfunc &task);
+    };
+
+    class BeeVGM;
+    struct BeeVGMEngineList;
+
+    // acquire() hands out an idle engine if there is one (or a new one if
+    // not), which goes back into the pool, after being reset, once it's
+    // let go of. It can be called from any number of threads at once.
+    //
+    // Engines can outlive the pool, in which case they're just deleted
+    class BeeVGMEnginePool
+    {
+	public:
+	    // Keeps at most 'max_idle' engines around (0 means no limit)
+	    BeeVGMEnginePool(size_t max_idle = 0);
+	    ~BeeVGMEnginePool();
+
+	    BeeVGMEnginePool(const BeeVGMEnginePool&) = delete;
+	    BeeVGMEnginePool &operator=(const BeeVGMEnginePool&) = delete;
+
+	    struct BeeVGMEngineReturn
+	    {
+		weak_ptr<BeeVGMEngineList> engine_list;
+		void operator()(BeeVGM *engine) const;
+	    };
+
+	    using engineptr = unique_ptr<BeeVGM, BeeVGMEngineReturn>;
+
+	    engineptr acquire();
+	    // Creates engines up front, until there are 'num_engines' idle ones
+	    void reserve(size_t num_engines);
+	    size_t num_idle();
+
+	private:
+	    shared_ptr<BeeVGMEngineList> engine_list;
+    };
+};
+
+#endif // BEEVGM_POOL_H
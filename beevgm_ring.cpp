@@ -0,0 +1,94 @@
+/*
+    This file is part of the BeeVGM engine.
+    Copyright (C) 2022 BueniaDev.
+
+    BeeVGM is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    BeeVGM is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with BeeVGM.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <cstring>
+#include "beevgm_ring.h"
+using namespace beevgm;
+using namespace std;
+
+BeeVGMRingBuffer::BeeVGMRingBuffer(size_t num_frames) : read_pos(0), write_pos(0)
+{
+    resize(num_frames);
+}
+
+BeeVGMRingBuffer::~BeeVGMRingBuffer()
+{
+
+}
+
+void BeeVGMRingBuffer::resize(size_t num_frames)
+{
+    num_slots = max<size_t>(num_frames, 1);
+    buffer.assign((num_slots * 2), 0);
+    read_pos.store(0, memory_order_relaxed);
+    write_pos.store(0, memory_order_relaxed);
+}
+
+size_t BeeVGMRingBuffer::space() const
+{
+    size_t read_frame = read_pos.load(memory_order_acquire);
+    size_t write_frame = write_pos.load(memory_order_relaxed);
+    return (num_slots - (write_frame - read_frame));
+}
+
+size_t BeeVGMRingBuffer::available() const
+{
+    size_t write_frame = write_pos.load(memory_order_acquire);
+    size_t read_frame = read_pos.load(memory_order_relaxed);
+    return (write_frame - read_frame);
+}
+
+size_t BeeVGMRingBuffer::write(const int16_t *samples, size_t num_frames)
+{
+    size_t write_frame = write_pos.load(memory_order_relaxed);
+    num_frames = min(num_frames, space());
+
+    if (num_frames == 0)
+    {
+	return 0;
+    }
+
+    // Copied in up to two pieces, if it wraps around the end of the buffer
+    size_t start_slot = (write_frame % num_slots);
+    size_t first_frames = min(num_frames, (num_slots - start_slot));
+    memcpy(&buffer[(start_slot * 2)], samples, (first_frames * 2 * sizeof(int16_t)));
+    memcpy(&buffer[0], &samples[(first_frames * 2)], ((num_frames - first_frames) * 2 * sizeof(int16_t)));
+
+    write_pos.store((write_frame + num_frames), memory_order_release);
+    return num_frames;
+}
+
+size_t BeeVGMRingBuffer::read(int16_t *samples, size_t num_frames)
+{
+    size_t read_frame = read_pos.load(memory_order_relaxed);
+    num_frames = min(num_frames, available());
+
+    if (num_frames == 0)
+    {
+	return 0;
+    }
+
+    size_t start_slot = (read_frame % num_slots);
+    size_t first_frames = min(num_frames, (num_slots - start_slot));
+    memcpy(samples, &buffer[(start_slot * 2)], (first_frames * 2 * sizeof(int16_t)));
+    memcpy(&samples[(first_frames * 2)], &buffer[0], ((num_frames - first_frames) * 2 * sizeof(int16_t)));
+
+    read_pos.store((read_frame + num_frames), memory_order_release);
+    return num_frames;
+}
@@ -0,0 +1,79 @@
+/*
+    This file is part of the BeeVGM engine.
+    Copyright (C) 2022 BueniaDev.
+
+    BeeVGM is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    BeeVGM is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with BeeVGM.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// BeeVGM - lock-free ring buffer
+//
+// Passes interleaved stereo frames from one thread (i.e. the one
+// rendering) to one other thread (i.e. an audio callback) without either
+// of them ever taking a lock, so the audio side never has to wait on
+// the rendering side.
+//
+// The read and write positions only ever count up, and each one is only
+// ever changed by its own side, so the other side just needs to see the
+// frames before it sees the position move past them.
+
+#ifndef BEEVGM_RING_H
+#define BEEVGM_RING_H
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <atomic>
+using namespace std;
+
+namespace beevgm
+{
+    class BeeVGMRingBuffer
+    {
+	public:
+	    BeeVGMRingBuffer(size_t num_frames = 0);
+	    ~BeeVGMRingBuffer();
+
+	    BeeVGMRingBuffer(const BeeVGMRingBuffer&) = delete;
+	    BeeVGMRingBuffer &operator=(const BeeVGMRingBuffer&) = delete;
+
+	    // Makes room for 'num_frames' frames, emptying the buffer
+	    // (neither side can be using it at the time)
+	    void resize(size_t num_frames);
+
+	    size_t capacity() const
+	    {
+		return num_slots;
+	    }
+
+	    // Writer side: the number of frames that can be written right now,
+	    // and writes up to 'num_frames' frames, returning how many were written
+	    size_t space() const;
+	    size_t write(const int16_t *samples, size_t num_frames);
+
+	    // Reader side: the number of frames waiting to be read, and reads
+	    // up to 'num_frames' frames, returning how many were read
+	    size_t available() const;
+	    size_t read(int16_t *samples, size_t num_frames);
+
+	private:
+	    vector<int16_t> buffer;
+	    size_t num_slots = 0;
+
+	    // Kept on separate cache lines, since they're written by different threads
+	    alignas(64) atomic<size_t> read_pos;
+	    alignas(64) atomic<size_t> write_pos;
+    };
+};
+
+#endif // BEEVGM_RING_H
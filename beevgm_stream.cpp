@@ -0,0 +1,393 @@
+/*
+    This file is part of the BeeVGM engine.
+    Copyright (C) 2022 BueniaDev.
+
+    BeeVGM is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    BeeVGM is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with BeeVGM.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include "beevgm_stream.h"
+#include "beevgm_log.h"
+using namespace beevgm;
+using namespace std;
+
+BeeVGMDACStreams::BeeVGMDACStreams()
+{
+
+}
+
+BeeVGMDACStreams::~BeeVGMDACStreams()
+{
+
+}
+
+void BeeVGMDACStreams::init(BeeVGMPCMBanks &banks, writefunc func, uint32_t samplerate)
+{
+    pcm_banks = &banks;
+    write_func = func;
+    sample_rate = samplerate;
+    reset();
+}
+
+void BeeVGMDACStreams::reset()
+{
+    streams.clear();
+    num_running = 0;
+}
+
+void BeeVGMDACStreams::set_streams(const vector<BeeVGMDACStream> &stream_list)
+{
+    streams = stream_list;
+    num_running = count_if(streams.begin(), streams.end(), [](const BeeVGMDACStream &stream) {
+	return stream.is_running;
+    });
+}
+
+BeeVGMChipID BeeVGMDACStreams::get_chip_id(uint8_t chip_type)
+{
+    switch (chip_type)
+    {
+	case 0x00: return ChipSN76489;
+	case 0x01: return ChipYM2413;
+	case 0x02: return ChipYM2612;
+	case 0x03: return ChipYM2151;
+	case 0x05: return ChipRF5C68;
+	case 0x06: return ChipYM2203;
+	case 0x08: return ChipYM2610;
+	case 0x09: return ChipYM3812;
+	case 0x0A: return ChipYM3526;
+	case 0x0B: return ChipY8950;
+	case 0x0C: return ChipYMF262;
+	case 0x0F: return ChipYMZ280B;
+	case 0x15: return ChipMultiPCM;
+	default: return ChipNone;
+    }
+}
+
+// Stream ID 0xFF is reserved
+BeeVGMDACStream *BeeVGMDACStreams::get_stream(uint8_t stream_id, bool is_create)
+{
+    if (stream_id == 0xFF)
+    {
+	return nullptr;
+    }
+
+    if (stream_id >= streams.size())
+    {
+	if (!is_create)
+	{
+	    return nullptr;
+	}
+
+	streams.resize((stream_id + 1));
+    }
+
+    return &streams[stream_id];
+}
+
+void BeeVGMDACStreams::command(const BeeVGMCommand &cmd)
+{
+    uint8_t stream_id = cmd.instance;
+
+    switch (cmd.type)
+    {
+	case CmdStreamSetup: setup(stream_id, cmd.chip, cmd.port, cmd.reg); break;
+	case CmdStreamData: set_data(stream_id, cmd.port, cmd.reg, cmd.value); break;
+	case CmdStreamFreq: set_frequency(stream_id, cmd.data); break;
+	case CmdStreamStop: stop(stream_id); break;
+	case CmdStreamStartFast: start_block(stream_id, cmd.reg, cmd.port); break;
+	default: break;
+    }
+}
+
+void BeeVGMDACStreams::setup(uint8_t stream_id, uint8_t chip_type, uint8_t port, uint8_t reg)
+{
+    auto stream = get_stream(stream_id, true);
+
+    if (stream == nullptr)
+    {
+	return;
+    }
+
+    BeeVGMChipID chip_id = get_chip_id((chip_type & 0x7F));
+
+    if (chip_id == ChipNone)
+    {
+	BEEVGM_LOG(LogWarning, "Unsupported DAC stream chip type of " << hex << int((chip_type & 0x7F)));
+    }
+
+    if (stream->is_running)
+    {
+	stop_stream(*stream);
+    }
+
+    stream->is_setup = (chip_id != ChipNone);
+    stream->chip = chip_id;
+    stream->instance = (chip_type >> 7);
+    stream->port = port;
+    stream->reg = reg;
+}
+
+void BeeVGMDACStreams::set_data(uint8_t stream_id, uint8_t bank_id, uint8_t step_size, uint8_t step_base)
+{
+    auto stream = get_stream(stream_id, true);
+
+    if (stream == nullptr)
+    {
+	return;
+    }
+
+    stream->bank_id = (bank_id & 0x3F);
+    stream->step_size = step_size;
+    stream->step_base = step_base;
+}
+
+void BeeVGMDACStreams::set_frequency(uint8_t stream_id, uint32_t frequency)
+{
+    auto stream = get_stream(stream_id, true);
+
+    if (stream == nullptr)
+    {
+	return;
+    }
+
+    // The current position is kept, so a running stream carries on at the new rate
+    stream->frequency = frequency;
+    update_step(*stream);
+}
+
+void BeeVGMDACStreams::update_step(BeeVGMDACStream &stream)
+{
+    stream.step_inc = ((uint64_t(stream.frequency) << 32) / sample_rate);
+}
+
+void BeeVGMDACStreams::start(uint8_t stream_id, const BeeVGMStreamStart &params)
+{
+    uint32_t data_start = params.data_start;
+    uint8_t length_mode = params.length_mode;
+    uint32_t length = params.length;
+
+    auto stream = get_stream(stream_id, false);
+
+    if ((stream == nullptr) || !stream->is_setup)
+    {
+	return;
+    }
+
+    uint32_t bank_size = pcm_banks->at(stream->bank_id).size();
+    uint32_t step_size = max<uint32_t>(stream->step_size, 1);
+
+    // A start offset of -1 leaves the current one as it is
+    if (data_start != 0xFFFFFFFF)
+    {
+	stream->data_start = min<uint32_t>((data_start + stream->step_base), bank_size);
+    }
+
+    switch ((length_mode & 0x0F))
+    {
+	// Keep the current length
+	case 0x00: break;
+	// Length is the number of commands
+	case 0x01: stream->num_cmds = length; break;
+	// Length is in milliseconds
+	case 0x02: stream->num_cmds = ((uint64_t(length) * stream->frequency) / 1000); break;
+	// Play until the end of the data (counting from the start offset, before the step base was added)
+	case 0x03:
+	{
+	    uint32_t start_offset = (stream->data_start - min<uint32_t>(stream->step_base, stream->data_start));
+	    stream->num_cmds = ((bank_size - start_offset) / step_size);
+	}
+	break;
+	default: stream->num_cmds = 0; break;
+    }
+
+    start_stream(*stream, ((length_mode & 0x80) != 0));
+}
+
+void BeeVGMDACStreams::start_block(uint8_t stream_id, uint16_t block_id, uint8_t flags)
+{
+    auto stream = get_stream(stream_id, false);
+
+    if ((stream == nullptr) || !stream->is_setup)
+    {
+	return;
+    }
+
+    const auto &bank = pcm_banks->at(stream->bank_id);
+
+    if (!bank.is_block_valid(block_id))
+    {
+	BEEVGM_LOG(LogWarning, "Invalid DAC stream block ID of " << dec << int(block_id));
+	return;
+    }
+
+    const auto &block = bank.get_block(block_id);
+    uint32_t step_size = max<uint32_t>(stream->step_size, 1);
+
+    // The step base applies here too (it's how interleaved streams pick their channel)
+    stream->data_start = min<uint32_t>((block.offset + stream->step_base), bank.size());
+    stream->num_cmds = (block.size / step_size);
+    start_stream(*stream, ((flags & 0x01) != 0));
+}
+
+void BeeVGMDACStreams::stop(uint8_t stream_id)
+{
+    if (stream_id == 0xFF)
+    {
+	for (auto &stream : streams)
+	{
+	    stop_stream(stream);
+	}
+
+	return;
+    }
+
+    auto stream = get_stream(stream_id, false);
+
+    if (stream != nullptr)
+    {
+	stop_stream(*stream);
+    }
+}
+
+void BeeVGMDACStreams::start_stream(BeeVGMDACStream &stream, bool is_loop)
+{
+    if (!stream.is_running)
+    {
+	num_running += 1;
+    }
+
+    stream.is_running = true;
+    stream.is_loop = is_loop;
+    stream.cmd_index = 0;
+    stream.cmds_sent = 0;
+    stream.step_pos = 0;
+    update_step(stream);
+
+    if (stream.num_cmds == 0)
+    {
+	stop_stream(stream);
+    }
+}
+
+void BeeVGMDACStreams::stop_stream(BeeVGMDACStream &stream)
+{
+    if (stream.is_running)
+    {
+	num_running -= 1;
+    }
+
+    stream.is_running = false;
+}
+
+// Entering an output sample sends every command up to
+// (step_pos / 2^32) + 1, so the first command goes out
+// as soon as the stream is started
+void BeeVGMDACStreams::advance(size_t num_samples)
+{
+    if (num_samples == 0)
+    {
+	return;
+    }
+
+    for (auto &stream : streams)
+    {
+	if (!stream.is_running)
+	{
+	    continue;
+	}
+
+	uint64_t last_pos = (stream.step_pos + ((num_samples - 1) * stream.step_inc));
+	stream.step_pos = (last_pos + stream.step_inc);
+	send_writes(stream, ((last_pos >> 32) + 1));
+    }
+}
+
+void BeeVGMDACStreams::send_writes(BeeVGMDACStream &stream, uint64_t num_due)
+{
+    const auto &bank = pcm_banks->at(stream.bank_id);
+    uint32_t step_size = max<uint32_t>(stream.step_size, 1);
+
+    BeeVGMCommand cmd;
+    cmd.type = CmdWrite;
+    cmd.chip = stream.chip;
+    cmd.instance = stream.instance;
+    cmd.port = stream.port;
+    cmd.reg = stream.reg;
+
+    while (stream.is_running && (stream.cmds_sent < num_due))
+    {
+	size_t data_pos = (stream.data_start + (size_t(stream.cmd_index) * step_size));
+
+	if (!bank.is_valid(data_pos))
+	{
+	    stop_stream(stream);
+	    break;
+	}
+
+	cmd.value = bank.read(data_pos);
+	write_func(cmd);
+
+	stream.cmds_sent += 1;
+	stream.cmd_index += 1;
+
+	if (stream.cmd_index >= stream.num_cmds)
+	{
+	    if (stream.is_loop)
+	    {
+		stream.cmd_index = 0;
+	    }
+	    else
+	    {
+		stop_stream(stream);
+	    }
+	}
+    }
+}
+
+size_t BeeVGMDACStreams::samples_until_write(size_t max_samples) const
+{
+    size_t num_samples = max_samples;
+
+    for (auto &stream : streams)
+    {
+	if (!stream.is_running)
+	{
+	    continue;
+	}
+
+	// The first command of a stream goes out on the very next sample
+	if (stream.cmds_sent == 0)
+	{
+	    return 1;
+	}
+
+	if (stream.step_inc == 0)
+	{
+	    continue;
+	}
+
+	uint64_t next_pos = (stream.cmds_sent << 32);
+
+	if (stream.step_pos >= next_pos)
+	{
+	    return 1;
+	}
+
+	uint64_t num_steps = (((next_pos - stream.step_pos) + (stream.step_inc - 1)) / stream.step_inc);
+	num_samples = min<uint64_t>(num_samples, (num_steps + 1));
+    }
+
+    return max<size_t>(num_samples, 1);
+}
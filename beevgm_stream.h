@@ -0,0 +1,129 @@
+/*
+    This file is part of the BeeVGM engine.
+    Copyright (C) 2022 BueniaDev.
+
+    BeeVGM is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    BeeVGM is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with BeeVGM.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// BeeVGM - DAC Stream Control (commands 0x90-0x95)
+//
+// Streams are run by the renderer rather than the command decoder:
+// each output sample, every running stream advances a 32.32 fixed-point
+// position by (frequency / sample rate), and sends one chip write per
+// whole step it crosses, from its PCM data bank.
+
+#ifndef BEEVGM_STREAM_H
+#define BEEVGM_STREAM_H
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <functional>
+#include "beevgm_command.h"
+#include "beevgm_pcm.h"
+using namespace std;
+
+namespace beevgm
+{
+    struct BeeVGMDACStream
+    {
+	bool is_setup = false;
+	bool is_running = false;
+	bool is_loop = false;
+
+	// Destination chip write
+	uint8_t chip = ChipNone;
+	uint8_t instance = 0;
+	uint8_t port = 0;
+	uint8_t reg = 0;
+
+	// Source data
+	uint8_t bank_id = 0;
+	uint8_t step_size = 1;
+	uint8_t step_base = 0;
+	uint32_t frequency = 0;
+
+	uint32_t data_start = 0;
+	uint32_t num_cmds = 0;
+
+	// Playback state
+	uint32_t cmd_index = 0;
+	uint64_t cmds_sent = 0;
+	uint64_t step_pos = 0;
+	uint64_t step_inc = 0;
+    };
+
+    class BeeVGMDACStreams
+    {
+	public:
+	    BeeVGMDACStreams();
+	    ~BeeVGMDACStreams();
+
+	    using writefunc = function<void(const BeeVGMCommand&)>;
+
+	    void init(BeeVGMPCMBanks &banks, writefunc func, uint32_t samplerate = 44100);
+	    void reset();
+
+	    // Handles a stream control command (except for stream starts, see below)
+	    void command(const BeeVGMCommand &cmd);
+	    // Handles command 0x93, whose parameters live in the command stream's start table
+	    void start(uint8_t stream_id, const BeeVGMStreamStart &params);
+
+	    bool is_active() const
+	    {
+		return (num_running != 0);
+	    }
+
+	    // Enters the next 'num_samples' output samples, sending every
+	    // write that falls due along the way
+	    void advance(size_t num_samples = 1);
+
+	    // Returns the number of output samples that can be entered
+	    // before the next write falls due (at least 1, at most 'max_samples')
+	    size_t samples_until_write(size_t max_samples) const;
+
+	    // Every stream's setup and playback state, for seek keyframes
+	    const vector<BeeVGMDACStream> &get_streams() const
+	    {
+		return streams;
+	    }
+
+	    void set_streams(const vector<BeeVGMDACStream> &stream_list);
+
+	    // Maps a DAC stream chip type (as in the header clock order) to a chip ID
+	    static BeeVGMChipID get_chip_id(uint8_t chip_type);
+
+	private:
+	    BeeVGMPCMBanks *pcm_banks = nullptr;
+	    writefunc write_func;
+	    uint32_t sample_rate = 44100;
+
+	    vector<BeeVGMDACStream> streams;
+	    size_t num_running = 0;
+
+	    BeeVGMDACStream *get_stream(uint8_t stream_id, bool is_create);
+	    void setup(uint8_t stream_id, uint8_t chip_type, uint8_t port, uint8_t reg);
+	    void set_data(uint8_t stream_id, uint8_t bank_id, uint8_t step_size, uint8_t step_base);
+	    void set_frequency(uint8_t stream_id, uint32_t frequency);
+	    void start_block(uint8_t stream_id, uint16_t block_id, uint8_t flags);
+	    void stop(uint8_t stream_id);
+
+	    void start_stream(BeeVGMDACStream &stream, bool is_loop);
+	    void stop_stream(BeeVGMDACStream &stream);
+	    void update_step(BeeVGMDACStream &stream);
+	    void send_writes(BeeVGMDACStream &stream, uint64_t num_due);
+    };
+};
+
+#endif // BEEVGM_STREAM_H
@@ -0,0 +1,357 @@
+/*
+    This file is part of the BeeVGM engine.
+    Copyright (C) 2022 BueniaDev.
+
+    BeeVGM is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    BeeVGM is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with BeeVGM.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// BeeVGM's benchmark suite
+//
+// Times each chip core on its own, the mixer, and (for any VGM files
+// given) command decoding, GD3 tag parsing and end-to-end rendering,
+// and writes the results out as JSON, so runs from different versions
+// of the cores can be compared by a script.
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <functional>
+#include <chrono>
+#include <memory>
+#include "beevgm.h"
+using namespace beevgm;
+using namespace std;
+
+// Number of frames rendered per call (the same as in vgm2wav)
+constexpr size_t render_frames = 2048;
+
+// Each test runs for at least this long (can be changed with -s)
+double min_test_secs = 0.5;
+
+// Runs 'func' over and over until it's taken at least 'min_test_secs'
+// altogether, and returns the average time per run in seconds
+double timerepeated(function<void()> func)
+{
+    uint64_t num_runs = 0;
+    auto start = chrono::steady_clock::now();
+    chrono::duration<double> elapsed(0.0);
+
+    do
+    {
+	func();
+	num_runs += 1;
+	elapsed = (chrono::steady_clock::now() - start);
+    } while (elapsed.count() < min_test_secs);
+
+    return (elapsed.count() / double(num_runs));
+}
+
+string jsonstring(const string &str)
+{
+    ostringstream out;
+    out << '"';
+
+    for (char c : str)
+    {
+	switch (c)
+	{
+	    case '"': out << "\\\""; break;
+	    case '\\': out << "\\\\"; break;
+	    case '\n': out << "\\n"; break;
+	    case '\r': out << "\\r"; break;
+	    case '\t': out << "\\t"; break;
+	    default:
+	    {
+		if (uint8_t(c) < 0x20)
+		{
+		    out << "\\u" << hex << setw(4) << setfill('0') << int(c) << dec;
+		}
+		else
+		{
+		    out << c;
+		}
+	    }
+	    break;
+	}
+    }
+
+    out << '"';
+    return out.str();
+}
+
+// Clocks a single chip with nothing playing on it (most cores cost
+// about the same whether or not they're playing anything)
+template<class T>
+string benchchip(string name, uint32_t clock_rate)
+{
+    cerr << "Benchmarking " << name << "..." << endl;
+
+    auto chip = make_unique<T>();
+    chip->init(clock_rate);
+
+    BeeVGMMixer mixer;
+
+    double block_secs = timerepeated([&] {
+	mixer.clear(render_frames);
+	chip->add_samples(mixer, render_frames);
+    });
+
+    double ns_per_sample = ((block_secs * 1e9) / double(render_frames));
+    double realtime_factor = ((double(render_frames) / 44100.0) / block_secs);
+
+    ostringstream out;
+    out << "{\"name\": " << jsonstring(name) << ", \"clock\": " << clock_rate;
+    out << ", \"ns_per_sample\": " << ns_per_sample << ", \"realtime_factor\": " << realtime_factor << "}";
+    return out.str();
+}
+
+vector<string> benchchips()
+{
+    return {
+	benchchip<SNPSG>("SNPSG", 3579545),
+	benchchip<OPLL>("OPLL", 3579545),
+	benchchip<OPN2Type>("OPN2Type", 7670453),
+	benchchip<OPM>("OPM", 3579545),
+	benchchip<OPN>("OPN", 4000000),
+	benchchip<OPNB>("OPNB", 8000000),
+	benchchip<OPL>("OPL", 3579545),
+	benchchip<OPL_MSX>("OPL_MSX", 3579545),
+	benchchip<OPL2>("OPL2", 3579545),
+	benchchip<OPL3>("OPL3", 14318180),
+	benchchip<beevgm::SegaPCM>("SegaPCM", 4000000),
+	benchchip<beevgm::YMZ280B>("YMZ280B", 16934400),
+	benchchip<beevgm::RF5C68>("RF5C68", 12500000),
+	benchchip<MultiPCMType>("MultiPCMType", 8053975),
+    };
+}
+
+// Mixes a block from four chips, with each of the mixer's versions that this CPU supports
+vector<string> benchmixer()
+{
+    constexpr size_t num_chips = 4;
+
+    vector<int32_t> chip_left(render_frames);
+    vector<int32_t> chip_right(render_frames);
+    vector<int16_t> out((render_frames * 2));
+
+    for (size_t i = 0; i < render_frames; i++)
+    {
+	chip_left[i] = int32_t((i * 7919) % 65536) - 32768;
+	chip_right[i] = int32_t((i * 104729) % 65536) - 32768;
+    }
+
+    vector<string> results;
+
+    for (auto isa : {MixerScalar, MixerSSE2, MixerAVX2})
+    {
+	if (!BeeVGMMixer::is_isa_supported(isa))
+	{
+	    continue;
+	}
+
+	BeeVGMMixer mixer;
+	mixer.set_isa(isa);
+	cerr << "Benchmarking the " << mixer.get_isa_name() << " mixer..." << endl;
+
+	double block_secs = timerepeated([&] {
+	    mixer.clear(render_frames);
+
+	    for (size_t chip = 0; chip < num_chips; chip++)
+	    {
+		mixer.add(chip_left.data(), chip_right.data(), render_frames);
+	    }
+
+	    mixer.output(out.data(), render_frames);
+	});
+
+	ostringstream result;
+	result << "{\"isa\": " << jsonstring(mixer.get_isa_name()) << ", \"chips\": " << num_chips;
+	result << ", \"ns_per_frame\": " << ((block_secs * 1e9) / double(render_frames)) << "}";
+	results.push_back(result.str());
+    }
+
+    return results;
+}
+
+// Decoding on its own (all of the commands, and the register writes they
+// make, but without clocking any chips), GD3 parsing, and rendering the
+// whole file (including loading it)
+string benchfile(string filename)
+{
+    cerr << "Benchmarking " << filename << "..." << endl;
+
+    ostringstream out;
+    out << "{\"file\": " << jsonstring(filename);
+
+    BeeVGM vgmcore;
+
+    if (!vgmcore.loadFile(filename))
+    {
+	out << ", \"error\": " << jsonstring(vgmcore.getErrorString()) << "}";
+	return out.str();
+    }
+
+    // Loading the whole file first keeps decompression out of the timing
+    vgmcore.getGD3Tag();
+
+    uint64_t num_commands = 0;
+    uint64_t num_samples = 0;
+
+    double decode_secs = timerepeated([&] {
+	vgmcore.reload();
+	num_commands = 0;
+	num_samples = 0;
+
+	while (!vgmcore.isEndofStream())
+	{
+	    num_samples += vgmcore.decodeFrame();
+	    num_commands += 1;
+	}
+    });
+
+    out << ", \"decode\": {\"commands\": " << num_commands << ", \"commands_per_sec\": " << (double(num_commands) / decode_secs) << "}";
+
+    BeeVGMFile vgm_file;
+    vgm_file.open(filename);
+
+    while (!vgm_file.is_complete())
+    {
+	vgm_file.inflate_more();
+    }
+
+    BeeVGMSpan vgm_data = vgm_file.span();
+    bool is_gd3_found = false;
+
+    double gd3_secs = timerepeated([&] {
+	BeeGD3 tag;
+	is_gd3_found = tag.open(vgm_data);
+
+	for (int field = 0; field < GD3NumFields; field++)
+	{
+	    tag.get_utf8(BeeGD3Field(field));
+	}
+    });
+
+    out << ", \"gd3\": {\"found\": " << (is_gd3_found ? "true" : "false") << ", \"us_per_parse\": " << (gd3_secs * 1e6) << "}";
+
+    array<int16_t, (render_frames * 2)> render_buffer;
+    uint64_t num_frames = 0;
+
+    double render_secs = timerepeated([&] {
+	BeeVGM render_core;
+	render_core.loadFile(filename);
+	num_frames = 0;
+
+	while (true)
+	{
+	    size_t block_frames = render_core.render(render_buffer.data(), render_frames);
+	    num_frames += block_frames;
+
+	    if (block_frames < render_frames)
+	    {
+		break;
+	    }
+	}
+    });
+
+    double audio_secs = (double(num_frames) / 44100.0);
+    out << ", \"render\": {\"audio_seconds\": " << audio_secs << ", \"wall_seconds\": " << render_secs;
+    out << ", \"realtime_factor\": " << (audio_secs / render_secs) << "}}";
+    return out.str();
+}
+
+void writelist(ostream &out, string name, const vector<string> &items, bool is_last)
+{
+    out << "  \"" << name << "\": [";
+
+    for (size_t index = 0; index < items.size(); index++)
+    {
+	out << ((index == 0) ? "\n    " : ",\n    ") << items[index];
+    }
+
+    out << (items.empty() ? "]" : "\n  ]") << (is_last ? "\n" : ",\n");
+}
+
+int main(int argc, char *argv[])
+{
+    string out_file;
+    vector<string> files;
+
+    for (int i = 1; i < argc; i++)
+    {
+	string arg = argv[i];
+
+	if ((arg == "-s") && ((i + 1) < argc))
+	{
+	    min_test_secs = stod(argv[++i]);
+	}
+	else if ((arg == "-o") && ((i + 1) < argc))
+	{
+	    out_file = argv[++i];
+	}
+	else if ((arg == "-h") || (arg == "--help"))
+	{
+	    cout << "Usage: beevgm_bench [-s seconds per test] [-o output JSON file] [VGM files...]" << endl;
+	    return 0;
+	}
+	else
+	{
+	    files.push_back(arg);
+	}
+    }
+
+    // Only errors are worth seeing, and they go to stderr along with the
+    // progress messages, so they can't get mixed into the JSON on stdout
+    BeeVGMLog::set_level(LogError);
+    BeeVGMLog::set_sink([](BeeVGMLogLevel, const string &msg) {
+	cerr << msg << endl;
+    });
+
+    vector<string> chip_results = benchchips();
+    vector<string> mixer_results = benchmixer();
+    vector<string> file_results;
+
+    for (auto &file : files)
+    {
+	file_results.push_back(benchfile(file));
+    }
+
+    ostringstream json;
+    json << "{\n";
+    json << "  \"sample_rate\": 44100,\n";
+    json << "  \"block_frames\": " << render_frames << ",\n";
+    json << "  \"test_seconds\": " << min_test_secs << ",\n";
+    writelist(json, "chips", chip_results, false);
+    writelist(json, "mixer", mixer_results, false);
+    writelist(json, "files", file_results, true);
+    json << "}\n";
+
+    if (out_file.empty())
+    {
+	cout << json.str();
+	return 0;
+    }
+
+    ofstream file(out_file);
+
+    if (!file.is_open())
+    {
+	cerr << "Could not open " << out_file << endl;
+	return 1;
+    }
+
+    file << json.str();
+    return 0;
+}
@@ -69,7 +69,7 @@ class BeeVGM_MultiPCM
 	{
 	    if (type == 0)
 	    {
-		chip.writeROM(rom_size, data_start, data_len, rom_data);
+		chip.writeROM(rom_size, data_start, data_len, move(rom_data));
 	    }
 	}
 
@@ -90,6 +90,17 @@ class BeeVGM_MultiPCM
 	    return final_samples;
 	}
 
+	void clock_block(int32_t *left, int32_t *right, size_t num_samples)
+	{
+	    for (size_t i = 0; i < num_samples; i++)
+	    {
+		chip.clockchip();
+		auto samples = chip.get_samples();
+		left[i] = samples[0];
+		right[i] = samples[1];
+	    }
+	}
+
     private:
 	MultiPCM chip;
 
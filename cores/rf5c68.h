@@ -65,7 +65,7 @@ class BeeVGM_RF5C68
 
 	void writeRAM(int data_start, int data_len, vector<uint8_t> ram_data)
 	{
-	    chip.writeRAM(data_start, data_len, ram_data);
+	    chip.writeRAM(data_start, data_len, move(ram_data));
 	}
 
 	void clock()
@@ -80,6 +80,17 @@ class BeeVGM_RF5C68
 	    return final_samples;
 	}
 
+	void clock_block(int32_t *left, int32_t *right, size_t num_samples)
+	{
+	    for (size_t i = 0; i < num_samples; i++)
+	    {
+		chip.clockchip();
+		auto samples = chip.get_samples();
+		left[i] = samples[0];
+		right[i] = samples[1];
+	    }
+	}
+
     private:
 	RF5C68 chip;
 
@@ -58,7 +58,7 @@ class BeeVGM_SegaPCM
 
 	void writeROM(int type, size_t rom_size, size_t data_start, size_t data_len, vector<uint8_t> rom_data)
 	{
-	    chip.writeROM(rom_size, data_start, data_len, rom_data);
+	    chip.writeROM(rom_size, data_start, data_len, move(rom_data));
 	}
 
 	void writeRAM(int data_start, int data_len, vector<uint8_t> ram_data)
@@ -78,6 +78,17 @@ class BeeVGM_SegaPCM
 	    return final_samples;
 	}
 
+	void clock_block(int32_t *left, int32_t *right, size_t num_samples)
+	{
+	    for (size_t i = 0; i < num_samples; i++)
+	    {
+		chip.clockchip();
+		auto samples = chip.get_samples();
+		left[i] = samples[0];
+		right[i] = samples[1];
+	    }
+	}
+
     private:
 	SegaPCM chip;
 
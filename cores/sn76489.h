@@ -81,6 +81,17 @@ class BeeVGM_SN76489
 	    return final_samples;
 	}
 
+	void clock_block(int32_t *left, int32_t *right, size_t num_samples)
+	{
+	    for (size_t i = 0; i < num_samples; i++)
+	    {
+		chip.clockchip();
+		auto samples = chip.get_samples();
+		left[i] = samples[0];
+		right[i] = samples[1];
+	    }
+	}
+
     private:
 	SN76489 chip;
 };
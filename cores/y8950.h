@@ -54,7 +54,7 @@ class BeeVGM_Y8950
 	{
 	    if (type == 0)
 	    {
-		chip.writeROM(rom_size, data_start, data_len, rom_data);
+		chip.writeROM(rom_size, data_start, data_len, move(rom_data));
 	    }
 	}
 
@@ -76,6 +76,17 @@ class BeeVGM_Y8950
 	    return final_samples;
 	}
 
+	void clock_block(int32_t *left, int32_t *right, size_t num_samples)
+	{
+	    for (size_t i = 0; i < num_samples; i++)
+	    {
+		chip.clockchip();
+		int32_t sample = chip.get_samples()[0];
+		left[i] = sample;
+		right[i] = sample;
+	    }
+	}
+
     private:
 	YM3526 chip;
 };
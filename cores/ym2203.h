@@ -64,7 +64,7 @@ class BeeVGM_YM2203
     public:
 	BeeVGM_YM2203()
 	{
-	    chip.set_ssg_interface(new BeeNuked_OPNSSG(ssg));
+	    chip.set_ssg_interface(&ssg);
 	    chip.init();
 	}
 
@@ -73,6 +73,20 @@ class BeeVGM_YM2203
 
 	}
 
+	// Copies keep the SSG interface pointed at their own SSG
+	BeeVGM_YM2203(const BeeVGM_YM2203 &other) : chip(other.chip), ssg(other.ssg)
+	{
+	    chip.set_ssg_interface(&ssg);
+	}
+
+	BeeVGM_YM2203 &operator=(const BeeVGM_YM2203 &other)
+	{
+	    chip = other.chip;
+	    ssg = other.ssg;
+	    chip.set_ssg_interface(&ssg);
+	    return *this;
+	}
+
 	uint32_t get_sample_rate(uint32_t clock_rate)
 	{
 	    return chip.get_sample_rate(clock_rate);
@@ -119,6 +133,25 @@ class BeeVGM_YM2203
 	    return final_samples;
 	}
 
+	void clock_block(int32_t *left, int32_t *right, size_t num_samples)
+	{
+	    for (size_t i = 0; i < num_samples; i++)
+	    {
+		chip.clockchip();
+		auto samples = chip.get_samples();
+
+		int32_t final_sample = 0;
+
+		for (auto &sample : samples)
+		{
+		    final_sample += sample;
+		}
+
+		left[i] = final_sample;
+		right[i] = final_sample;
+	    }
+	}
+
     private:
 	YM2203 chip;
 	BeeNuked_OPNSSG ssg;
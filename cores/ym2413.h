@@ -73,6 +73,17 @@ class BeeVGM_YM2413
 	    return final_samples;
 	}
 
+	void clock_block(int32_t *left, int32_t *right, size_t num_samples)
+	{
+	    for (size_t i = 0; i < num_samples; i++)
+	    {
+		chip.clockchip();
+		int32_t sample = chip.get_samples()[0];
+		left[i] = sample;
+		right[i] = sample;
+	    }
+	}
+
     private:
 	YM2413 chip;
 };
@@ -64,7 +64,7 @@ class BeeVGM_YM2610
     public:
 	BeeVGM_YM2610()
 	{
-	    chip.set_ssg_interface(new BeeNuked_OPNBSSG(ssg));
+	    chip.set_ssg_interface(&ssg);
 	}
 
 	~BeeVGM_YM2610()
@@ -72,6 +72,20 @@ class BeeVGM_YM2610
 
 	}
 
+	// Copies keep the SSG interface pointed at their own SSG
+	BeeVGM_YM2610(const BeeVGM_YM2610 &other) : chip(other.chip), ssg(other.ssg)
+	{
+	    chip.set_ssg_interface(&ssg);
+	}
+
+	BeeVGM_YM2610 &operator=(const BeeVGM_YM2610 &other)
+	{
+	    chip = other.chip;
+	    ssg = other.ssg;
+	    chip.set_ssg_interface(&ssg);
+	    return *this;
+	}
+
 	uint32_t get_sample_rate(uint32_t clock_rate)
 	{
 	    return chip.get_sample_rate(clock_rate);
@@ -91,11 +105,11 @@ class BeeVGM_YM2610
 	{
 	    if (type == 0)
 	    {
-		chip.writeADPCM_ROM(rom_size, data_start, data_len, rom_data);
+		chip.writeADPCM_ROM(rom_size, data_start, data_len, move(rom_data));
 	    }
 	    else if (type == 1)
 	    {
-		chip.writeDelta_ROM(rom_size, data_start, data_len, rom_data);
+		chip.writeDelta_ROM(rom_size, data_start, data_len, move(rom_data));
 	    }
 	}
 
@@ -123,6 +137,19 @@ class BeeVGM_YM2610
 	    return final_samples;
 	}
 
+	void clock_block(int32_t *left, int32_t *right, size_t num_samples)
+	{
+	    for (size_t i = 0; i < num_samples; i++)
+	    {
+		chip.clockchip();
+		auto samples = chip.get_samples();
+
+		int32_t fm_sample = (samples[0] * 3);
+		left[i] = (fm_sample + samples[1]);
+		right[i] = (fm_sample + samples[2]);
+	    }
+	}
+
     private:
 	YM2610 chip;
 	BeeNuked_OPNBSSG ssg;
@@ -78,6 +78,17 @@ class BeeVGM_YMF262
 	    return final_samples;
 	}
 
+	void clock_block(int32_t *left, int32_t *right, size_t num_samples)
+	{
+	    for (size_t i = 0; i < num_samples; i++)
+	    {
+		chip.clockchip();
+		auto samples = chip.get_samples();
+		left[i] = mix_sample(samples[0], samples[2]);
+		right[i] = mix_sample(samples[1], samples[3]);
+	    }
+	}
+
     private:
 	YMF262 chip;
 
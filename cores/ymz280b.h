@@ -54,7 +54,7 @@ class BeeVGM_YMZ280B
 	{
 	    if (type == 0)
 	    {
-		chip.writeROM(rom_size, data_start, data_len, rom_data);
+		chip.writeROM(rom_size, data_start, data_len, move(rom_data));
 	    }
 	}
 
@@ -75,6 +75,17 @@ class BeeVGM_YMZ280B
 	    return final_samples;
 	}
 
+	void clock_block(int32_t *left, int32_t *right, size_t num_samples)
+	{
+	    for (size_t i = 0; i < num_samples; i++)
+	    {
+		chip.clockchip();
+		auto samples = chip.get_samples();
+		left[i] = samples[0];
+		right[i] = samples[1];
+	    }
+	}
+
     private:
 	YMZ280B chip;
 };
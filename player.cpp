@@ -18,226 +18,290 @@
 
 // BeeVGM's official VGM player frontend
 //
-// Leverages em_inflate tiny inflater from https://github.com/emmanuel-marty/em_inflate
+// Rendering runs on a thread of its own, which keeps a ring buffer topped
+// up, and SDL's audio callback just copies out of that buffer, so the
+// output latency only depends on the size of SDL's buffer, and not on
+// how long any one render call takes.
 
 #include <iostream>
 #include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
 #include <signal.h>
-#include <utfcpp/utf8.h>
 #include <SDL2/SDL.h>
-#include "em_inflate.h"
 #include "beevgm.h"
+#include "beevgm_ring.h"
 using namespace beevgm;
 using namespace std;
-using namespace utf8;
 using namespace std::placeholders;
 
-vector<int16_t> audiobuffer;
+// Number of frames rendered per call to BeeVGM::render()
+// (kept small, so the ring buffer can be topped up in small steps)
+constexpr size_t render_frames = 256;
 
-bool is_exit = false;
+// Default output latency (the size of SDL's buffer) and ring buffer depth, in milliseconds
+constexpr uint32_t default_latency_ms = 10;
+constexpr uint32_t default_buffer_ms = 50;
+
+atomic<bool> is_exit(false);
+
+BeeVGMRingBuffer audio_ring;
+SDL_AudioDeviceID audio_device = 0;
+
+// Set once the last frame has been written to the ring buffer
+atomic<bool> is_decode_done(false);
+// Number of times the callback ran out of frames before the end
+atomic<uint64_t> num_underruns(0);
+
+// Signaled by the callback whenever it's made more room in the ring buffer
+mutex space_mutex;
+condition_variable space_cond;
+chrono::milliseconds space_wait_time(default_latency_ms);
 
 void signal_callback(int signum)
 {
-    cout << "Exiting..." << endl;
     is_exit = true;
 }
 
-vector<uint8_t> loadFile(string filename)
+void printGD3Tag(BeeVGM &vgm)
 {
-    vector<uint8_t> result;
-    ifstream file(filename.c_str(), ios::in | ios::binary | ios::ate);
+    const BeeGD3 &tag = vgm.getGD3Tag();
 
-    if (!file.is_open())
+    if (!tag.is_found())
     {
-	return result;
+	cout << "No GD3 tag found" << endl;
+	return;
     }
 
-    streampos size = file.tellg();
-    result.resize(size, 0);
-    file.seekg(0, ios::beg);
-    file.read((char*)result.data(), result.size());
-    file.close();
-    return result;
+    cout << "Gd3 info: " << endl;
+    cout << "Track name (English): " << tag.get_utf8(GD3TrackNameEN) << endl;
+    cout << "Track name (Japanese): " << tag.get_utf8(GD3TrackNameJP) << endl;
+    cout << "Game name (English): " << tag.get_utf8(GD3GameNameEN) << endl;
+    cout << "Game name (Japanese): " << tag.get_utf8(GD3GameNameJP) << endl;
+    cout << "System name (English): " << tag.get_utf8(GD3SysNameEN) << endl;
+    cout << "System name (Japanese): " << tag.get_utf8(GD3SysNameJP) << endl;
+    cout << "Track author (English): " << tag.get_utf8(GD3TrackAuthorEN) << endl;
+    cout << "Track author (Japanese): " << tag.get_utf8(GD3TrackAuthorJP) << endl;
+    cout << "Game release date: " << tag.get_utf8(GD3GameReleaseDate) << endl;
+    cout << "Converted by: " << tag.get_utf8(GD3NameOfConverter) << endl;
+    cout << "Notes: " << tag.get_utf8(GD3Notes) << endl;
+    cout << endl;
 }
 
-bool decompressVGM(vector<uint8_t> vgm_memory, vector<uint8_t> &vgm_data)
+// Runs on SDL's audio thread, so it mustn't block: whatever
+// isn't in the ring buffer yet is just played as silence
+void audio_callback(void *userdata, Uint8 *stream, int len)
 {
-    uint8_t *end = &vgm_memory[vgm_memory.size()];
-    uint32_t uncompressed = end[-4] | (end[-3] << 8) | (end[-2] << 16) | (end[-1] << 24);
-    vgm_data.resize(uncompressed, 0);
+    int16_t *out = reinterpret_cast<int16_t*>(stream);
+    size_t num_frames = (len / (2 * sizeof(int16_t)));
+    size_t frames_read = audio_ring.read(out, num_frames);
 
-    int result = em_inflate(vgm_memory.data(), vgm_memory.size(), vgm_data.data(), vgm_data.size());
-
-    if (result == -1)
+    if (frames_read < num_frames)
     {
-	cout << "Error decompressing data from file" << endl;
-	return false;
+	fill(&out[(frames_read * 2)], &out[(num_frames * 2)], 0);
+
+	if (!is_decode_done.load(memory_order_acquire))
+	{
+	    num_underruns.fetch_add(1, memory_order_relaxed);
+	}
     }
 
-    return true;
+    space_cond.notify_one();
 }
 
-string gd3_vec_to_utf8(BeeGD3_Vec vec)
+// Waits for the callback to make more room in the ring buffer (the wait is
+// capped, since the callback doesn't take the lock, so a signal can be missed)
+void waitforspace()
 {
-    string utf8_tag;
-    utf16to8(vec.begin(), vec.end(), back_inserter(utf8_tag));
-    return utf8_tag;
+    unique_lock<mutex> lock(space_mutex);
+    space_cond.wait_for(lock, space_wait_time);
 }
 
-
-void printGD3Tag(BeeVGM &vgm)
+// Writes all of 'samples' to the ring buffer, starting playback once it's
+// been filled up for the first time, and returns false if we're exiting
+bool outputsamples(const int16_t *samples, size_t num_frames)
 {
-    BeeGD3 tag = vgm.getGD3Tag();
+    size_t frames_done = 0;
 
-    if (!tag.is_found())
+    while (frames_done < num_frames)
     {
-	cout << "No GD3 tag found" << endl;
-	return;
+	frames_done += audio_ring.write(&samples[(frames_done * 2)], (num_frames - frames_done));
+
+	if (frames_done == num_frames)
+	{
+	    break;
+	}
+
+	SDL_PauseAudioDevice(audio_device, 0);
+	waitforspace();
+
+	if (is_exit)
+	{
+	    return false;
+	}
     }
 
-    cout << "Gd3 info: " << endl;
-    cout << "Track name (English): " << gd3_vec_to_utf8(tag.get_track_name_en()) << endl;
-    cout << "Track name (Japanese): " << gd3_vec_to_utf8(tag.get_track_name_jp()) << endl;
-    cout << "Game name (English): " << gd3_vec_to_utf8(tag.get_game_name_en()) << endl;
-    cout << "Game name (Japanese): " << gd3_vec_to_utf8(tag.get_game_name_jp()) << endl;
-    cout << "System name (English): " << gd3_vec_to_utf8(tag.get_sys_name_en()) << endl;
-    cout << "System name (Japanese): " << gd3_vec_to_utf8(tag.get_sys_name_jp()) << endl;
-    cout << "Track author (English): " << gd3_vec_to_utf8(tag.get_track_author_en()) << endl;
-    cout << "Track author (Japanese): " << gd3_vec_to_utf8(tag.get_track_author_jp()) << endl;
-    cout << "Game release date: " << gd3_vec_to_utf8(tag.get_game_release_date()) << endl;
-    cout << "Converted by: " << gd3_vec_to_utf8(tag.get_name_of_converter()) << endl;
-    cout << "Notes: " << gd3_vec_to_utf8(tag.get_notes()) << endl;
-    cout << endl;
+    return true;
 }
 
-vector<uint8_t> loadVGM(string filename)
+void decodeaudio(BeeVGM &vgmcore)
 {
-    vector<uint8_t> emptyvec; // Empty vector (return value if file loading fails)
-    vector<uint8_t> data = loadFile(filename);
+    bool is_loop_around = false;
+    bool is_tag_printed = false;
 
-    if (data.empty())
-    {
-	return emptyvec;
-    }
+    array<int16_t, (render_frames * 2)> render_buffer;
 
-    if (data.size() >= 10 && (data[0] == 0x1F && data[1] == 0x8B && data[2] == 0x08))
+    while (!is_exit)
     {
-	vector<uint8_t> compressed_data = data;
+	size_t num_frames = vgmcore.render(render_buffer.data(), render_frames);
 
-	vector<uint8_t> uncompressed_data;
+	if (!outputsamples(render_buffer.data(), num_frames))
+	{
+	    break;
+	}
 
-	if (!decompressVGM(compressed_data, uncompressed_data))
+	// .vgz files start playing while they're still being decompressed,
+	// and the GD3 tag is at the very end of the file
+	if (!is_tag_printed && vgmcore.isLoadComplete())
 	{
-	    return emptyvec;
+	    printGD3Tag(vgmcore);
+	    is_tag_printed = true;
 	}
 
-	return uncompressed_data;
+	// End of stream
+	if (num_frames < render_frames)
+	{
+	    // If the VGM file has a loop offset, then loop around once
+	    uint32_t loop_offs = vgmcore.getLoopOffset();
+
+	    if ((loop_offs != 0) && !is_loop_around)
+	    {
+		vgmcore.seekLoop(loop_offs);
+		is_loop_around = true;
+	    }
+	    else
+	    {
+		break;
+	    }
+	}
     }
 
-    return data;
-}
+    is_decode_done.store(true, memory_order_release);
 
-void outputsample(array<int16_t, 2> sample)
-{
-    audiobuffer.push_back(sample[0]);
-    audiobuffer.push_back(sample[1]);
+    // Starts playback if the whole file fit in the buffer, then drains whatever's left
+    SDL_PauseAudioDevice(audio_device, 0);
 
-    if (audiobuffer.size() >= 4096)
+    while (!is_exit && (audio_ring.available() != 0))
     {
-	audiobuffer.clear();
+	waitforspace();
+    }
+}
 
-	while (SDL_GetQueuedAudioSize(1) > (4096 * sizeof(int16_t)))
-	{
-	    SDL_Delay(1);
-	}
+// Picks SDL's buffer size for an output latency of at most 'latency_ms'
+// milliseconds (SDL wants a power of 2)
+uint16_t getdeviceframes(uint32_t latency_ms)
+{
+    uint32_t max_frames = ((44100 * latency_ms) / 1000);
+    uint32_t num_frames = 64;
 
-	SDL_QueueAudio(1, audiobuffer.data(), (4096 * sizeof(int16_t)));
+    while (((num_frames * 2) <= max_frames) && (num_frames < 32768))
+    {
+	num_frames *= 2;
     }
+
+    return num_frames;
 }
 
 int main(int argc, char* argv[])
 {
     cout << "Welcome to the Blythie VGM Player." << endl;
 
-    if (argc < 2)
-    {
-	cout << "Usage: vgmplayer [VGM file]" << endl;
-	return 1;
-    }
+    uint32_t latency_ms = default_latency_ms;
+    uint32_t buffer_ms = default_buffer_ms;
+    size_t render_threads = 1;
+    string filename;
 
-    signal(SIGINT, signal_callback);
+    for (int i = 1; i < argc; i++)
+    {
+	string arg = argv[i];
 
-    vector<uint8_t> vgm_data = loadVGM(argv[1]);
+	if ((arg == "-l") && ((i + 1) < argc))
+	{
+	    latency_ms = stoul(argv[++i]);
+	}
+	else if ((arg == "-b") && ((i + 1) < argc))
+	{
+	    buffer_ms = stoul(argv[++i]);
+	}
+	else if ((arg == "-t") && ((i + 1) < argc))
+	{
+	    render_threads = stoul(argv[++i]);
+	}
+	else
+	{
+	    filename = arg;
+	}
+    }
 
-    if (vgm_data.empty())
+    if (filename.empty())
     {
-	cout << "Could not load VGM file." << endl;
+	cout << "Usage: vgmplayer [-l latency in ms] [-b buffer depth in ms] [-t render threads] [VGM file]" << endl;
 	return 1;
     }
 
+    signal(SIGINT, signal_callback);
+
     BeeVGM vgmcore;
+    vgmcore.setRenderThreads(render_threads);
 
-    if (!vgmcore.load(vgm_data))
+    if (!vgmcore.loadFile(filename))
     {
-	cout << "Could not parse VGM file." << endl;
+	cout << "Could not load VGM file: " << vgmcore.getErrorString() << endl;
 	return 1;
     }
 
-    printGD3Tag(vgmcore);
-
-    bool is_loop_around = false;
-
     SDL_Init(SDL_INIT_AUDIO);
 
     SDL_AudioSpec audiospec;
+    SDL_zero(audiospec);
     audiospec.freq = 44100;
     audiospec.format = AUDIO_S16SYS;
     audiospec.channels = 2;
-    audiospec.samples = 4096;
-    audiospec.callback = NULL;
+    audiospec.samples = getdeviceframes(latency_ms);
+    audiospec.callback = audio_callback;
 
-    SDL_OpenAudio(&audiospec, NULL);
-    SDL_PauseAudio(0);
+    SDL_AudioSpec device_spec;
+    audio_device = SDL_OpenAudioDevice(NULL, 0, &audiospec, &device_spec, 0);
 
-    while (!is_exit)
+    if (audio_device == 0)
     {
-	uint32_t num_samples = vgmcore.decodeFrame();
+	cout << "Could not open audio device: " << SDL_GetError() << endl;
+	SDL_Quit();
+	return 1;
+    }
 
-	if (num_samples > 0)
-	{
-	    for (uint32_t i = 0; i < num_samples; i++)
-	    {
-		array<int16_t, 2> audiosample = vgmcore.generateSample();
-		outputsample(audiosample);
-	    }
-	}
+    // The ring buffer has to hold at least a couple of SDL's buffers' worth
+    size_t buffer_frames = ((44100 * buffer_ms) / 1000);
+    audio_ring.resize(max<size_t>(buffer_frames, (device_spec.samples * 2)));
+    space_wait_time = chrono::milliseconds(max<uint32_t>(1, ((device_spec.samples * 1000) / 44100)));
 
-	// End of stream
-	if (vgmcore.isEndofStream())
-	{
-	    // If the VGM file has a loop offset, then loop around once
-	    uint32_t loop_offs = vgmcore.getLoopOffset();
+    cout << "Output latency: " << ((device_spec.samples * 1000) / 44100) << " ms (";
+    cout << device_spec.samples << " frames), buffer depth: " << ((audio_ring.capacity() * 1000) / 44100) << " ms" << endl;
 
-	    if ((loop_offs != 0) && !is_loop_around)
-	    {
-		vgmcore.seekLoop(loop_offs);
-		is_loop_around = true;
-	    }
-	    else
-	    {
-		// Drain any remaining queued audio
-		while (SDL_GetQueuedAudioSize(1) > 0)
-		{
-		    SDL_Delay(1);
-		}
+    thread decode_thread(decodeaudio, ref(vgmcore));
+    decode_thread.join();
 
-		break;
-	    }
-	}
+    if (is_exit)
+    {
+	cout << "Exiting..." << endl;
     }
-	
-    SDL_PauseAudio(1);
-    SDL_CloseAudio();
+
+    SDL_CloseAudioDevice(audio_device);
     SDL_Quit();
+
+    cout << "Underruns: " << num_underruns.load() << endl;
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,109 @@
+/*
+    This file is part of the BeeVGM engine.
+    Copyright (C) 2022 BueniaDev.
+
+    BeeVGM is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    BeeVGM is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with BeeVGM.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// BeeVGM - PCM data block decompression tests
+//
+// Each test decompresses a hand-built block, and checks the bank
+// against the output of the reference decoder.
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include "beevgm_pcm.h"
+using namespace beevgm;
+using namespace std;
+
+bool checkbank(string name, BeeVGMPCMBanks &banks, size_t bank_type, const vector<uint8_t> &expected)
+{
+    const auto &bank = banks[bank_type];
+    vector<uint8_t> actual;
+
+    for (size_t index = 0; index < bank.size(); index++)
+    {
+	actual.push_back(bank.read(index));
+    }
+
+    if (actual != expected)
+    {
+	cout << "[FAILED] " << name << endl;
+	return false;
+    }
+
+    cout << "[OK] " << name << endl;
+    return true;
+}
+
+// 12-bit values 0xABC, 0x123 and 0xFFF, each packed as its low 8 bits followed by its high 4 bits
+bool test12bitcopy()
+{
+    vector<uint8_t> block = {
+	0x00, // n-bit compression
+	0x06, 0x00, 0x00, 0x00, // 6 bytes out
+	16, 12, // 16 bits out, 12 bits in
+	0x00, // Copy
+	0x00, 0x00, // Nothing added
+	0xBC, 0xA2, 0x31, 0xFF, 0xF0
+    };
+
+    BeeVGMPCMBanks banks;
+    banks.add_compressed_block(0, BeeVGMSpan(block.data(), block.size()));
+    return checkbank("12-bit copy", banks, 0, {0xBC, 0x0A, 0x23, 0x01, 0xFF, 0x0F});
+}
+
+// A table with fewer entries than the compressed values can reach (the last value is past the end)
+bool testshorttable()
+{
+    vector<uint8_t> table = {
+	0x00, // n-bit compression
+	0x02, // Table
+	8, 4, // 8 bits out, 4 bits in
+	0x03, 0x00, // 3 entries
+	10, 20, 30
+    };
+
+    vector<uint8_t> block = {
+	0x00, // n-bit compression
+	0x04, 0x00, 0x00, 0x00, // 4 bytes out
+	8, 4, // 8 bits out, 4 bits in
+	0x02, // Table
+	0x00, 0x00, // Nothing added
+	0x01, 0x25
+    };
+
+    BeeVGMPCMBanks banks;
+    banks.add_stream_block(0x7F, BeeVGMSpan(table.data(), table.size()));
+    banks.add_compressed_block(0, BeeVGMSpan(block.data(), block.size()));
+    return checkbank("Short table", banks, 0, {10, 20, 30, 0});
+}
+
+int main(int argc, char *argv[])
+{
+    int num_failed = 0;
+
+    if (!test12bitcopy())
+    {
+	num_failed += 1;
+    }
+
+    if (!testshorttable())
+    {
+	num_failed += 1;
+    }
+
+    return (num_failed == 0) ? 0 : 1;
+}
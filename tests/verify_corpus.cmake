@@ -0,0 +1,56 @@
+# BeeVGM - golden output regression test
+#
+# Generates the vgmgen stress corpus, then checks it with vgmverify. MODE is one of:
+#
+# verify - checks the corpus against the goldens in GOLDEN_DIR (which fails if there aren't any)
+# update - saves new goldens to GOLDEN_DIR
+# repeat - saves goldens to GOLDEN_DIR, then checks a second run (on several
+#          render threads) against them, so the corpus has to play without
+#          errors and come out the same every time
+#
+# Goldens depend on the exact emulation cores, so the ones in tests/goldens have
+# to be saved again (with the update_goldens target) whenever a core is deliberately changed.
+#
+# Expects VGMGEN, VGMVERIFY, CORPUS_DIR, GOLDEN_DIR and MODE to be set with -D.
+
+# The corpus has to come out the same every time for the goldens to mean anything
+set(CORPUS_ARGS -s 2 -r 1)
+
+file(REMOVE_RECURSE "${CORPUS_DIR}")
+file(MAKE_DIRECTORY "${CORPUS_DIR}")
+
+execute_process(COMMAND "${VGMGEN}" -o "${CORPUS_DIR}" ${CORPUS_ARGS} RESULT_VARIABLE result)
+
+if (NOT result EQUAL 0)
+    message(FATAL_ERROR "vgmgen could not generate the corpus")
+endif()
+
+file(GLOB corpus_files "${CORPUS_DIR}/*.vgm")
+list(SORT corpus_files)
+
+if (MODE STREQUAL "update")
+    execute_process(COMMAND "${VGMVERIFY}" -u -g "${GOLDEN_DIR}" ${corpus_files} RESULT_VARIABLE result)
+elseif (MODE STREQUAL "repeat")
+    file(REMOVE_RECURSE "${GOLDEN_DIR}")
+    execute_process(COMMAND "${VGMVERIFY}" -u -g "${GOLDEN_DIR}" ${corpus_files} RESULT_VARIABLE result)
+
+    if (NOT result EQUAL 0)
+	message(FATAL_ERROR "vgmverify could not render the corpus")
+    endif()
+
+    execute_process(COMMAND "${VGMVERIFY}" -j 4 -g "${GOLDEN_DIR}" ${corpus_files} RESULT_VARIABLE result)
+elseif (MODE STREQUAL "verify")
+    file(GLOB golden_files "${GOLDEN_DIR}/*.golden")
+
+    if (NOT golden_files)
+	message(FATAL_ERROR "No goldens in ${GOLDEN_DIR} (save them with the update_goldens target)")
+    endif()
+
+    execute_process(COMMAND "${VGMVERIFY}" -g "${GOLDEN_DIR}" ${corpus_files} RESULT_VARIABLE result)
+else()
+    message(FATAL_ERROR "Unknown mode ${MODE}")
+endif()
+
+if (NOT result EQUAL 0)
+    message(FATAL_ERROR "vgmverify found differences from the goldens")
+endif()
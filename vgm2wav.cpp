@@ -17,177 +17,441 @@
 */
 
 // BeeVGM's official VGM-to-WAV converter
-//
-// Leverages em_inflate tiny inflater from https://github.com/emmanuel-marty/em_inflate
 
 #include <iostream>
 #include <functional>
-#include "em_inflate.h"
+#include <filesystem>
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <set>
 #include "beevgm.h"
+#include "beevgm_pool.h"
 using namespace beevgm;
 using namespace std;
 using namespace std::placeholders;
 
-vector<int16_t> audiobuffer;
+// Number of frames rendered per call to BeeVGM::render()
+constexpr size_t render_frames = 2048;
 
-vector<uint8_t> loadFile(string filename)
+// Number of frames buffered up before each write to the output file
+constexpr size_t write_frames = 65536;
+
+typedef struct WAV_HEADER {
+  /* RIFF Chunk Descriptor */
+  uint8_t RIFF[4] = {'R', 'I', 'F', 'F'}; // RIFF Header Magic header
+  uint32_t ChunkSize;                     // RIFF Chunk Size
+  uint8_t WAVE[4] = {'W', 'A', 'V', 'E'}; // WAVE Header
+  /* "fmt" sub-chunk */
+  uint8_t fmt[4] = {'f', 'm', 't', ' '}; // FMT header
+  uint32_t Subchunk1Size = 16;           // Size of the fmt chunk
+  uint16_t AudioFormat = 1; // Audio format 1=PCM,6=mulaw,7=alaw,     257=IBM
+                            // Mu-Law, 258=IBM A-Law, 259=ADPCM
+  uint16_t NumOfChan = 2;   // Number of channels 1=Mono 2=Sterio
+  uint32_t SamplesPerSec = 44100;   // Sampling Frequency in Hz
+  uint32_t bytesPerSec = 176400; // bytes per second
+  uint16_t blockAlign = 4;          // 2=16-bit mono, 4=16-bit stereo
+  uint16_t bitsPerSample = 16;      // Number of bits per sample
+  /* "data" sub-chunk */
+  uint8_t Subchunk2ID[4] = {'d', 'a', 't', 'a'}; // "data"  string
+  uint32_t Subchunk2Size;                        // Sampled data length
+} wav_hdr;
+
+// Streams samples out to a WAV file in large blocks, so memory use
+// doesn't depend on the length of the song, then goes back and
+// fills in the header's sizes once everything's been written
+class WAVWriter
+{
+    public:
+	WAVWriter()
+	{
+	    write_buffer.reserve((write_frames * 2));
+	}
+
+	~WAVWriter()
+	{
+	    close();
+	}
+
+	bool open(string filename)
+	{
+	    file.open(filename, ios::binary | ios::trunc);
+
+	    if (!file.is_open())
+	    {
+		return false;
+	    }
+
+	    // Written again with the actual sizes once we're done
+	    wav_hdr wav;
+	    wav.ChunkSize = (sizeof(wav_hdr) - 8);
+	    wav.Subchunk2Size = 0;
+	    file.write(reinterpret_cast<const char*>(&wav), sizeof(wav));
+	    data_size = 0;
+	    return file.good();
+	}
+
+	void write(const int16_t *samples, size_t num_frames)
+	{
+	    write_buffer.insert(write_buffer.end(), samples, (samples + (num_frames * 2)));
+
+	    if (write_buffer.size() >= (write_frames * 2))
+	    {
+		flush();
+	    }
+	}
+
+	bool close()
+	{
+	    if (!file.is_open())
+	    {
+		return false;
+	    }
+
+	    flush();
+
+	    wav_hdr wav;
+	    wav.ChunkSize = uint32_t(data_size + sizeof(wav_hdr) - 8);
+	    wav.Subchunk2Size = uint32_t(data_size);
+
+	    file.seekp(0, ios::beg);
+	    file.write(reinterpret_cast<const char*>(&wav), sizeof(wav));
+
+	    bool is_good = file.good();
+	    file.close();
+	    return is_good;
+	}
+
+    private:
+	ofstream file;
+	vector<int16_t> write_buffer;
+	uint64_t data_size = 0;
+
+	void flush()
+	{
+	    if (write_buffer.empty())
+	    {
+		return;
+	    }
+
+	    size_t num_bytes = (write_buffer.size() * sizeof(int16_t));
+	    file.write(reinterpret_cast<const char*>(write_buffer.data()), num_bytes);
+	    data_size += num_bytes;
+	    write_buffer.clear();
+	}
+};
+
+// Converts a VGM file to a WAV file (looping around once, if the file has a loop),
+// returning the number of frames written in 'num_frames'
+bool convertfile(BeeVGM &vgmcore, string in_file, string out_file, uint64_t &num_frames, string &error)
 {
-    vector<uint8_t> result;
-    ifstream file(filename.c_str(), ios::in | ios::binary | ios::ate);
+    bool is_loop_around = false;
+    num_frames = 0;
 
-    if (!file.is_open())
+    if (!vgmcore.loadFile(in_file))
     {
-	return result;
+	error = "Could not load VGM file: " + vgmcore.getErrorString();
+	return false;
     }
 
-    streampos size = file.tellg();
-    result.resize(size, 0);
-    file.seekg(0, ios::beg);
-    file.read((char*)result.data(), result.size());
-    file.close();
-    return result;
-}
+    WAVWriter wav_file;
 
-bool decompressVGM(vector<uint8_t> vgm_memory, vector<uint8_t> &vgm_data)
-{
-    uint8_t *end = &vgm_memory[vgm_memory.size()];
-    uint32_t uncompressed = end[-4] | (end[-3] << 8) | (end[-2] << 16) | (end[-1] << 24);
-    vgm_data.resize(uncompressed, 0);
+    if (!wav_file.open(out_file))
+    {
+	error = "Could not open output file.";
+	return false;
+    }
 
-    int result = em_inflate(vgm_memory.data(), vgm_memory.size(), vgm_data.data(), vgm_data.size());
+    array<int16_t, (render_frames * 2)> render_buffer;
 
-    if (result == -1)
+    while (true)
     {
-	cout << "Error decompressing data from file" << endl;
+	size_t block_frames = vgmcore.render(render_buffer.data(), render_frames);
+	wav_file.write(render_buffer.data(), block_frames);
+	num_frames += block_frames;
+
+	// End of stream
+	if (block_frames < render_frames)
+	{
+	    // If the VGM file has a loop offset, then loop around once
+	    uint32_t loop_offs = vgmcore.getLoopOffset();
+
+	    if ((loop_offs != 0) && !is_loop_around)
+	    {
+		vgmcore.seekLoop(loop_offs);
+		is_loop_around = true;
+	    }
+	    else
+	    {
+		break;
+	    }
+	}
+    }
+
+    if (!wav_file.close())
+    {
+	error = "Could not write output file.";
 	return false;
     }
 
     return true;
 }
 
-vector<uint8_t> loadVGM(string filename)
+struct BatchJob
 {
-    vector<uint8_t> emptyvec; // Empty vector (return value if file loading fails)
-    vector<uint8_t> data = loadFile(filename);
+    string in_file;
+    string out_file;
+    uintmax_t file_size = 0;
+};
 
-    if (data.empty())
-    {
-	return emptyvec;
-    }
+bool isvgmfile(const filesystem::path &path)
+{
+    string ext = path.extension().string();
+    transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    return ((ext == ".vgm") || (ext == ".vgz"));
+}
+
+// Inputs can be VGM files, directories (whose VGM files are all converted),
+// or manifests, given as '@file', which list one input per line
+bool addbatchinput(string input, vector<string> &files)
+{
+    error_code ec;
 
-    if (data.size() >= 10 && (data[0] == 0x1F && data[1] == 0x8B && data[2] == 0x08))
+    if (!input.empty() && (input[0] == '@'))
     {
-	vector<uint8_t> compressed_data = data;
+	ifstream manifest(input.substr(1));
 
-	vector<uint8_t> uncompressed_data;
+	if (!manifest.is_open())
+	{
+	    cout << "Could not open manifest " << input.substr(1) << endl;
+	    return false;
+	}
+
+	string line;
 
-	if (!decompressVGM(compressed_data, uncompressed_data))
+	while (getline(manifest, line))
 	{
-	    return emptyvec;
+	    if (!line.empty() && (line.back() == '\r'))
+	    {
+		line.pop_back();
+	    }
+
+	    if (line.empty() || (line[0] == '#'))
+	    {
+		continue;
+	    }
+
+	    if (!addbatchinput(line, files))
+	    {
+		return false;
+	    }
 	}
 
-	return uncompressed_data;
+	return true;
     }
 
-    return data;
-}
+    if (filesystem::is_directory(input, ec))
+    {
+	vector<string> dir_files;
 
-typedef struct WAV_HEADER {
-  /* RIFF Chunk Descriptor */
-  uint8_t RIFF[4] = {'R', 'I', 'F', 'F'}; // RIFF Header Magic header
-  uint32_t ChunkSize;                     // RIFF Chunk Size
-  uint8_t WAVE[4] = {'W', 'A', 'V', 'E'}; // WAVE Header
-  /* "fmt" sub-chunk */
-  uint8_t fmt[4] = {'f', 'm', 't', ' '}; // FMT header
-  uint32_t Subchunk1Size = 16;           // Size of the fmt chunk
-  uint16_t AudioFormat = 1; // Audio format 1=PCM,6=mulaw,7=alaw,     257=IBM
-                            // Mu-Law, 258=IBM A-Law, 259=ADPCM
-  uint16_t NumOfChan = 2;   // Number of channels 1=Mono 2=Sterio
-  uint32_t SamplesPerSec = 44100;   // Sampling Frequency in Hz
-  uint32_t bytesPerSec = 176400; // bytes per second
-  uint16_t blockAlign = 4;          // 2=16-bit mono, 4=16-bit stereo
-  uint16_t bitsPerSample = 16;      // Number of bits per sample
-  /* "data" sub-chunk */
-  uint8_t Subchunk2ID[4] = {'d', 'a', 't', 'a'}; // "data"  string
-  uint32_t Subchunk2Size;                        // Sampled data length
-} wav_hdr;
+	for (auto &entry : filesystem::directory_iterator(input, ec))
+	{
+	    if (entry.is_regular_file(ec) && isvgmfile(entry.path()))
+	    {
+		dir_files.push_back(entry.path().string());
+	    }
+	}
 
-void outputsample(array<int16_t, 2> sample)
-{
-    audiobuffer.push_back(sample[0]);
-    audiobuffer.push_back(sample[1]);
+	sort(dir_files.begin(), dir_files.end());
+	files.insert(files.end(), dir_files.begin(), dir_files.end());
+	return true;
+    }
+
+    files.push_back(input);
+    return true;
 }
 
-int main(int argc, char *argv[])
+int runbatch(int argc, char *argv[])
 {
-    cout << "Welcome to the Blythie VGM-to-WAV Converter." << endl;
+    size_t num_threads = 0;
+    string out_dir;
+    vector<string> files;
 
-    if (argc < 3)
+    for (int i = 2; i < argc; i++)
     {
-	cout << "Usage: vgm2wav [VGM file] [output file]" << endl;
-	return 1;
-    }
+	string arg = argv[i];
 
-    bool is_loop_around = false;
-    vector<uint8_t> vgm_data = loadVGM(argv[1]);
+	if ((arg == "-j") && ((i + 1) < argc))
+	{
+	    num_threads = stoul(argv[++i]);
+	}
+	else if ((arg == "-o") && ((i + 1) < argc))
+	{
+	    out_dir = argv[++i];
+	}
+	else if (!addbatchinput(arg, files))
+	{
+	    return 1;
+	}
+    }
 
-    if (vgm_data.empty())
+    if (files.empty())
     {
+	cout << "No VGM files to convert." << endl;
 	return 1;
     }
 
-    BeeVGM vgmcore;
-
-    if (!vgmcore.load(vgm_data))
+    if (!out_dir.empty())
     {
-	cout << "Could not parse VGM file." << endl;
-	return 1;
+	error_code ec;
+	filesystem::create_directories(out_dir, ec);
     }
 
-    while (true)
+    vector<BatchJob> jobs;
+    set<string> out_files;
+
+    for (auto &file : files)
     {
-	uint32_t num_samples = vgmcore.decodeFrame();
+	filesystem::path in_path(file);
+	filesystem::path out_path = in_path;
+	out_path.replace_extension(".wav");
 
-	if (num_samples > 0)
+	if (!out_dir.empty())
 	{
-	    for (uint32_t i = 0; i < num_samples; i++)
-	    {
-		array<int16_t, 2> audiosample = vgmcore.generateSample();
-		outputsample(audiosample);
-	    }
+	    out_path = (filesystem::path(out_dir) / out_path.filename());
 	}
 
-	// End of stream
-	if (vgmcore.isEndofStream())
+	// Two inputs can't be written to the same file (i.e. song.vgm and song.vgz),
+	// so keep the input's extension in the name if that happens
+	for (int index = 1; out_files.count(out_path.string()) != 0; index++)
 	{
-	    // If the VGM file has a loop offset, then loop around once
-	    uint32_t loop_offs = vgmcore.getLoopOffset();
+	    string suffix = (index == 1) ? ".wav" : ("." + to_string(index) + ".wav");
+	    out_path.replace_filename((in_path.filename().string() + suffix));
+	}
 
-	    if ((loop_offs != 0) && !is_loop_around)
+	out_files.insert(out_path.string());
+
+	BatchJob job;
+	job.in_file = in_path.string();
+	job.out_file = out_path.string();
+
+	error_code ec;
+	job.file_size = filesystem::file_size(in_path, ec);
+
+	if (ec)
+	{
+	    job.file_size = 0;
+	}
+
+	jobs.push_back(job);
+    }
+
+    // Start on the biggest files first, so they don't end up holding up the rest of the batch
+    stable_sort(jobs.begin(), jobs.end(), [](const BatchJob &a, const BatchJob &b) {
+	return (a.file_size > b.file_size);
+    });
+
+    // Per-file chip details would just interleave between threads, so only warnings get through
+    BeeVGMLog::set_level(LogWarning);
+
+    BeeVGMThreadPool pool(num_threads);
+    cout << "Converting " << jobs.size() << " files on " << pool.num_threads() << " threads..." << endl;
+
+    // One engine per worker
+    vector<unique_ptr<BeeVGM>> worker_cores(pool.num_threads());
+
+    mutex status_mutex;
+    size_t num_converted = 0;
+    size_t num_failed = 0;
+    uint64_t total_frames = 0;
+
+    auto batch_start = chrono::steady_clock::now();
+
+    for (auto &job : jobs)
+    {
+	pool.submit([&](size_t worker_id) {
+	    // Each worker's engine is reused from one file to the next
+	    if (worker_cores[worker_id] == nullptr)
 	    {
-		vgmcore.seekLoop(loop_offs);
-		is_loop_around = true;
+		worker_cores[worker_id] = make_unique<BeeVGM>();
+	    }
+
+	    auto job_start = chrono::steady_clock::now();
+
+	    uint64_t num_frames = 0;
+	    string error;
+	    bool is_converted = convertfile(*worker_cores[worker_id], job.in_file, job.out_file, num_frames, error);
+
+	    chrono::duration<double> job_time = (chrono::steady_clock::now() - job_start);
+	    double audio_secs = (double(num_frames) / 44100.0);
+
+	    lock_guard<mutex> lock(status_mutex);
+
+	    if (is_converted)
+	    {
+		num_converted += 1;
+		total_frames += num_frames;
+		cout << "[OK] " << job.in_file << " -> " << job.out_file << " (" << fixed << setprecision(1) << audio_secs << "s of audio in " << setprecision(2) << job_time.count() << "s)";
+
+		// Files that stopped early are still converted, up to that point
+		if (worker_cores[worker_id]->getError() != ErrorNone)
+		{
+		    cout << " [" << worker_cores[worker_id]->getErrorString() << "]";
+		}
+
+		cout << endl;
 	    }
 	    else
 	    {
-		break;
+		num_failed += 1;
+		cout << "[FAILED] " << job.in_file << ": " << error << endl;
 	    }
-	}
+	});
     }
 
-    wav_hdr wav;
-    wav.ChunkSize = ((audiobuffer.size() * 2) + sizeof(wav_hdr) - 8);
-    wav.Subchunk2Size = ((audiobuffer.size() * 2) + sizeof(wav_hdr) - 44);
+    pool.wait();
+
+    chrono::duration<double> batch_time = (chrono::steady_clock::now() - batch_start);
+    double total_secs = (double(total_frames) / 44100.0);
+    double total_mb = ((double(total_frames) * 4.0) / (1024.0 * 1024.0));
+    double wall_secs = max(batch_time.count(), 1e-9);
 
-    ofstream out(argv[2], ios::binary);
-    out.write(reinterpret_cast<const char*>(&wav), sizeof(wav));
+    cout << endl;
+    cout << "Converted " << num_converted << " of " << jobs.size() << " files (" << num_failed << " failed)" << endl;
+    cout << fixed << setprecision(1) << total_secs << "s of audio in " << setprecision(2) << wall_secs << "s (";
+    cout << setprecision(1) << (total_secs / wall_secs) << "x realtime, " << (double(jobs.size()) / wall_secs) << " files/s, ";
+    cout << (total_mb / wall_secs) << " MB/s written)" << endl;
+
+    return (num_failed == 0) ? 0 : 1;
+}
+
+int main(int argc, char *argv[])
+{
+    cout << "Welcome to the Blythie VGM-to-WAV Converter." << endl;
 
-    for (size_t i = 0; i < audiobuffer.size(); ++i)
+    if ((argc >= 2) && (string(argv[1]) == "--batch"))
     {
-	out.write(reinterpret_cast<char*>(&audiobuffer[i]), sizeof(int16_t));
+	return runbatch(argc, argv);
+    }
+
+    if (argc < 3)
+    {
+	cout << "Usage: vgm2wav [VGM file] [output file]" << endl;
+	cout << "       vgm2wav --batch [-j threads] [-o output dir] [VGM files, directories or @manifests...]" << endl;
+	return 1;
+    }
+
+    BeeVGM vgmcore;
+    uint64_t num_frames = 0;
+    string error;
+
+    if (!convertfile(vgmcore, argv[1], argv[2], num_frames, error))
+    {
+	cout << error << endl;
+	return 1;
     }
 
     cout << "WAV succesfully generated." << endl;
-    out.close();
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,816 @@
+/*
+    This file is part of the BeeVGM engine.
+    Copyright (C) 2022 BueniaDev.
+
+    BeeVGM is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    BeeVGM is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with BeeVGM.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// BeeVGM's stress corpus generator
+//
+// Writes out synthetic (but valid) VGM files that hammer each of the
+// chips the engine supports, so there's a reproducible set of worst-case
+// inputs to benchmark and test with. The same seed and settings always
+// produce the same files.
+//
+// Every file is written as a version 1.61 VGM, with the setup (data blocks,
+// chip initialization) before the loop point, so looping only replays
+// the register writes.
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <functional>
+#include <random>
+#include "beevgm.h"
+using namespace beevgm;
+using namespace std;
+
+// Settings shared by all of the scenarios
+struct VGMGenSettings
+{
+    // Length of each file (before looping)
+    uint32_t seconds = 10;
+    // Register writes per 1/60th of a second
+    uint32_t density = 64;
+    // Size of each ROM/PCM data block
+    uint32_t bank_size = (1024 * 1024);
+    uint32_t seed = 1;
+};
+
+class VGMWriter
+{
+    public:
+	VGMWriter(uint32_t seed) : rng(seed)
+	{
+	    data.resize(header_size, 0);
+	}
+
+	// Writes 'clock_rate' into the header at 'offset'
+	void set_clock(uint32_t offset, uint32_t clock_rate)
+	{
+	    write_at(offset, clock_rate);
+	}
+
+	void set_header_byte(uint32_t offset, uint8_t value)
+	{
+	    data.at(offset) = value;
+	}
+
+	void set_header_word(uint32_t offset, uint16_t value)
+	{
+	    data.at(offset) = (value & 0xFF);
+	    data.at((offset + 1)) = (value >> 8);
+	}
+
+	void set_header_long(uint32_t offset, uint32_t value)
+	{
+	    write_at(offset, value);
+	}
+
+	// Everything after this point gets replayed when the song loops
+	void set_loop()
+	{
+	    loop_pos = data.size();
+	    loop_sample = total_samples;
+	}
+
+	uint32_t random(uint32_t max_value)
+	{
+	    return (rng() % (max_value + 1));
+	}
+
+	uint32_t random_range(uint32_t min_value, uint32_t max_value)
+	{
+	    return (min_value + random((max_value - min_value)));
+	}
+
+	void write8(uint8_t value)
+	{
+	    data.push_back(value);
+	}
+
+	void write16(uint16_t value)
+	{
+	    write8((value & 0xFF));
+	    write8((value >> 8));
+	}
+
+	void write24(uint32_t value)
+	{
+	    write16((value & 0xFFFF));
+	    write8(((value >> 16) & 0xFF));
+	}
+
+	void write32(uint32_t value)
+	{
+	    write16((value & 0xFFFF));
+	    write16((value >> 16));
+	}
+
+	// Register write, in the form used by most chips (opcode, register, value)
+	void write_reg(uint8_t opcode, uint8_t reg, uint8_t value)
+	{
+	    write8(opcode);
+	    write8(reg);
+	    write8(value);
+	}
+
+	// Memory write (commands 0xC0 and 0xC1)
+	void write_mem(uint8_t opcode, uint16_t addr, uint8_t value)
+	{
+	    write8(opcode);
+	    write16(addr);
+	    write8(value);
+	}
+
+	void wait(uint32_t num_samples)
+	{
+	    total_samples += num_samples;
+
+	    while (num_samples > 0)
+	    {
+		if (num_samples == 735)
+		{
+		    write8(0x62);
+		    break;
+		}
+		else if (num_samples <= 16)
+		{
+		    write8((0x70 + (num_samples - 1)));
+		    break;
+		}
+
+		uint32_t step = min<uint32_t>(num_samples, 0xFFFF);
+		write8(0x61);
+		write16(step);
+		num_samples -= step;
+	    }
+	}
+
+	// YM2612 DAC write from the data bank, followed by a wait of 'num_samples' (0-15)
+	void write_dac(uint32_t num_samples)
+	{
+	    write8((0x80 + num_samples));
+	    total_samples += num_samples;
+	}
+
+	// Data block (command 0x67) holding 'block'
+	void write_block(uint8_t data_type, const vector<uint8_t> &block, bool is_second_chip = false)
+	{
+	    uint32_t block_size = block.size();
+
+	    if (is_second_chip)
+	    {
+		block_size |= 0x80000000;
+	    }
+
+	    write8(0x67);
+	    write8(0x66);
+	    write8(data_type);
+	    write32(block_size);
+	    data.insert(data.end(), block.begin(), block.end());
+	}
+
+	// ROM image data block (types 0x80-0xBF) of 'size' bytes of noise,
+	// for a chip with 'rom_size' bytes of ROM in all
+	void write_rom_block(uint8_t data_type, uint32_t rom_size, uint32_t size, bool is_second_chip = false)
+	{
+	    vector<uint8_t> block;
+	    block.reserve((size + 8));
+	    append32(block, rom_size);
+	    append32(block, 0);
+
+	    for (uint32_t i = 0; i < size; i++)
+	    {
+		block.push_back(random(0xFF));
+	    }
+
+	    write_block(data_type, block, is_second_chip);
+	}
+
+	// Data stream block (types 0x00-0x3F) holding 'size' bytes of a sawtooth wave
+	void write_stream_block(uint8_t data_type, uint32_t size)
+	{
+	    vector<uint8_t> block(size, 0);
+
+	    for (uint32_t i = 0; i < size; i++)
+	    {
+		block[i] = ((i * 3) & 0xFF);
+	    }
+
+	    write_block(data_type, block);
+	}
+
+	// Finishes off the file (end of stream command, GD3 tag and header) and writes it to 'filename'
+	bool save(string filename, string title)
+	{
+	    write8(0x66);
+
+	    uint32_t gd3_pos = data.size();
+	    write_gd3(title);
+
+	    write_at(0x00, 0x206D6756); // "Vgm "
+	    write_at(0x04, (data.size() - 0x04));
+	    write_at(0x08, 0x161);
+	    write_at(0x14, (gd3_pos - 0x14));
+	    write_at(0x18, total_samples);
+	    write_at(0x1C, (loop_pos - 0x1C));
+	    write_at(0x20, (total_samples - loop_sample));
+	    write_at(0x24, 60);
+	    write_at(0x34, (header_size - 0x34));
+
+	    ofstream file(filename.c_str(), ios::out | ios::binary);
+
+	    if (!file.is_open())
+	    {
+		return false;
+	    }
+
+	    file.write((char*)data.data(), data.size());
+	    return file.good();
+	}
+
+	size_t size() const
+	{
+	    return data.size();
+	}
+
+    private:
+	static constexpr uint32_t header_size = 0x100;
+
+	vector<uint8_t> data;
+	mt19937 rng;
+
+	uint32_t loop_pos = header_size;
+	uint32_t total_samples = 0;
+	uint32_t loop_sample = 0;
+
+	void write_at(uint32_t offset, uint32_t value)
+	{
+	    for (int i = 0; i < 4; i++)
+	    {
+		data.at((offset + i)) = ((value >> (i * 8)) & 0xFF);
+	    }
+	}
+
+	static void append32(vector<uint8_t> &block, uint32_t value)
+	{
+	    for (int i = 0; i < 4; i++)
+	    {
+		block.push_back(((value >> (i * 8)) & 0xFF));
+	    }
+	}
+
+	void write_gd3(string title)
+	{
+	    vector<uint8_t> tag;
+	    array<string, GD3NumFields> fields;
+	    fields[GD3TrackNameEN] = title;
+	    fields[GD3GameNameEN] = "BeeVGM stress corpus";
+	    fields[GD3NameOfConverter] = "vgmgen";
+	    fields[GD3Notes] = "Synthetic test data";
+
+	    for (auto &field : fields)
+	    {
+		// All of the text here is ASCII, which is the same in UTF-16
+		for (char c : field)
+		{
+		    tag.push_back(c);
+		    tag.push_back(0);
+		}
+
+		tag.push_back(0);
+		tag.push_back(0);
+	    }
+
+	    write32(0x20336447); // "Gd3 "
+	    write32(0x100);
+	    write32(tag.size());
+	    data.insert(data.end(), tag.begin(), tag.end());
+	}
+};
+
+// Calls 'write_func' 'density' times per 1/60th of a second, for the whole length of the file
+void writestorm(VGMWriter &vgm, const VGMGenSettings &settings, function<void()> write_func)
+{
+    uint32_t num_ticks = (settings.seconds * 60);
+
+    for (uint32_t tick = 0; tick < num_ticks; tick++)
+    {
+	for (uint32_t i = 0; i < settings.density; i++)
+	{
+	    write_func();
+	}
+
+	vgm.wait(735);
+    }
+}
+
+void gensn76489(VGMWriter &vgm, const VGMGenSettings &settings)
+{
+    vgm.set_clock(0x0C, 3579545);
+    vgm.set_header_word(0x28, 0x0009);
+    vgm.set_header_byte(0x2A, 16);
+    vgm.set_loop();
+
+    writestorm(vgm, settings, [&] {
+	vgm.write8(0x50);
+	vgm.write8(vgm.random(0xFF));
+    });
+}
+
+void genym2413(VGMWriter &vgm, const VGMGenSettings &settings)
+{
+    vgm.set_clock(0x10, 3579545);
+    vgm.set_loop();
+
+    writestorm(vgm, settings, [&] {
+	vgm.write_reg(0x51, vgm.random(0x38), vgm.random(0xFF));
+    });
+}
+
+void genym2612(VGMWriter &vgm, const VGMGenSettings &settings)
+{
+    vgm.set_clock(0x2C, 7670453);
+    vgm.set_loop();
+
+    writestorm(vgm, settings, [&] {
+	uint8_t port = vgm.random(1);
+	vgm.write_reg((0x52 + port), vgm.random_range(0x21, 0xB6), vgm.random(0xFF));
+    });
+}
+
+// YM2612 DAC writes on every sample, out of a large data bank
+void genym2612dac(VGMWriter &vgm, const VGMGenSettings &settings)
+{
+    vgm.set_clock(0x2C, 7670453);
+    vgm.write_stream_block(0x00, settings.bank_size);
+    vgm.write_reg(0x52, 0x2B, 0x80);
+    vgm.set_loop();
+
+    uint32_t num_samples = (settings.seconds * 44100);
+    uint32_t bank_pos = 0;
+
+    vgm.write8(0xE0);
+    vgm.write32(0);
+
+    for (uint32_t sample = 0; sample < num_samples; sample++)
+    {
+	// Seek back to the start of the bank once it's been played through
+	if (++bank_pos == settings.bank_size)
+	{
+	    vgm.write8(0xE0);
+	    vgm.write32(0);
+	    bank_pos = 0;
+	}
+
+	vgm.write_dac(1);
+    }
+}
+
+// YM2612 DAC writes, driven by a looping DAC stream instead of commands
+void genym2612stream(VGMWriter &vgm, const VGMGenSettings &settings)
+{
+    vgm.set_clock(0x2C, 7670453);
+    vgm.write_stream_block(0x00, settings.bank_size);
+    vgm.write_reg(0x52, 0x2B, 0x80);
+
+    // Stream 0 writes to the YM2612 register 0x2A, from bank 0, at 44.1 KHz
+    vgm.write8(0x90);
+    vgm.write8(0x00);
+    vgm.write8(0x02);
+    vgm.write8(0x00);
+    vgm.write8(0x2A);
+    vgm.write8(0x91);
+    vgm.write8(0x00);
+    vgm.write8(0x00);
+    vgm.write8(0x01);
+    vgm.write8(0x00);
+    vgm.write8(0x92);
+    vgm.write8(0x00);
+    vgm.write32(44100);
+    vgm.set_loop();
+
+    vgm.write8(0x95);
+    vgm.write8(0x00);
+    vgm.write16(0);
+    vgm.write8(0x01);
+
+    writestorm(vgm, settings, [&] {
+	vgm.write_reg(0x52, vgm.random_range(0x30, 0xB6), vgm.random(0xFF));
+    });
+}
+
+void genym2151(VGMWriter &vgm, const VGMGenSettings &settings)
+{
+    vgm.set_clock(0x30, 3579545);
+    vgm.set_loop();
+
+    writestorm(vgm, settings, [&] {
+	vgm.write_reg(0x54, vgm.random_range(0x01, 0xFF), vgm.random(0xFF));
+    });
+}
+
+void genym2203(VGMWriter &vgm, const VGMGenSettings &settings)
+{
+    vgm.set_clock(0x44, 4000000);
+    vgm.set_loop();
+
+    writestorm(vgm, settings, [&] {
+	vgm.write_reg(0x55, vgm.random(0xB6), vgm.random(0xFF));
+    });
+}
+
+void genym2610(VGMWriter &vgm, const VGMGenSettings &settings)
+{
+    vgm.set_clock(0x4C, 8000000);
+    vgm.write_rom_block(0x82, settings.bank_size, settings.bank_size);
+    vgm.write_rom_block(0x83, settings.bank_size, settings.bank_size);
+    vgm.set_loop();
+
+    writestorm(vgm, settings, [&] {
+	uint8_t port = vgm.random(1);
+	vgm.write_reg((0x58 + port), vgm.random(0xB6), vgm.random(0xFF));
+    });
+}
+
+void genym3812(VGMWriter &vgm, const VGMGenSettings &settings)
+{
+    vgm.set_clock(0x50, 3579545);
+    vgm.set_loop();
+
+    writestorm(vgm, settings, [&] {
+	vgm.write_reg(0x5A, vgm.random_range(0x01, 0xF5), vgm.random(0xFF));
+    });
+}
+
+void genym3526(VGMWriter &vgm, const VGMGenSettings &settings)
+{
+    vgm.set_clock(0x54, 3579545);
+    vgm.set_loop();
+
+    writestorm(vgm, settings, [&] {
+	vgm.write_reg(0x5B, vgm.random_range(0x01, 0xF5), vgm.random(0xFF));
+    });
+}
+
+void geny8950(VGMWriter &vgm, const VGMGenSettings &settings)
+{
+    vgm.set_clock(0x58, 3579545);
+    vgm.write_rom_block(0x88, settings.bank_size, settings.bank_size);
+    vgm.set_loop();
+
+    writestorm(vgm, settings, [&] {
+	vgm.write_reg(0x5C, vgm.random_range(0x01, 0xF5), vgm.random(0xFF));
+    });
+}
+
+void genymf262(VGMWriter &vgm, const VGMGenSettings &settings)
+{
+    vgm.set_clock(0x5C, 14318180);
+    // Switches on OPL3 mode
+    vgm.write_reg(0x5F, 0x05, 0x01);
+    vgm.set_loop();
+
+    writestorm(vgm, settings, [&] {
+	uint8_t port = vgm.random(1);
+	vgm.write_reg((0x5E + port), vgm.random_range(0x01, 0xF5), vgm.random(0xFF));
+    });
+}
+
+void gensegapcm(VGMWriter &vgm, const VGMGenSettings &settings)
+{
+    vgm.set_clock(0x38, 4000000);
+    vgm.set_header_long(0x3C, 0x000F8000);
+    vgm.write_rom_block(0x80, settings.bank_size, settings.bank_size);
+    vgm.set_loop();
+
+    writestorm(vgm, settings, [&] {
+	vgm.write_mem(0xC0, vgm.random(0xFF), vgm.random(0xFF));
+    });
+}
+
+void genymz280b(VGMWriter &vgm, const VGMGenSettings &settings)
+{
+    vgm.set_clock(0x68, 16934400);
+    vgm.write_rom_block(0x86, settings.bank_size, settings.bank_size);
+    vgm.set_loop();
+
+    writestorm(vgm, settings, [&] {
+	vgm.write_reg(0x5D, vgm.random(0xFF), vgm.random(0xFF));
+    });
+}
+
+// RF5C68 with its wave RAM filled every way there is (RAM data blocks,
+// RAM transfers out of a data bank, and single memory writes)
+void genrf5c68(VGMWriter &vgm, const VGMGenSettings &settings)
+{
+    constexpr uint32_t ram_size = 0x10000;
+
+    vgm.set_clock(0x40, 12500000);
+    vgm.write_stream_block(0x01, settings.bank_size);
+
+    vector<uint8_t> ram_block;
+    ram_block.push_back(0x00);
+    ram_block.push_back(0x00);
+
+    for (uint32_t i = 0; i < 0x1000; i++)
+    {
+	ram_block.push_back(vgm.random(0xFF));
+    }
+
+    vgm.write_block(0xC0, ram_block);
+    vgm.set_loop();
+
+    uint32_t num_ticks = (settings.seconds * 60);
+    uint32_t transfer_size = 0x1000;
+
+    for (uint32_t tick = 0; tick < num_ticks; tick++)
+    {
+	// One RAM transfer per tick, from all over the bank
+	vgm.write8(0x68);
+	vgm.write8(0x66);
+	vgm.write8(0x01);
+	vgm.write24(vgm.random((settings.bank_size - transfer_size)));
+	vgm.write24(vgm.random((ram_size - transfer_size)));
+	vgm.write24(transfer_size);
+
+	for (uint32_t i = 0; i < settings.density; i++)
+	{
+	    if (vgm.random(1) == 0)
+	    {
+		vgm.write_reg(0xB0, vgm.random(0x08), vgm.random(0xFF));
+	    }
+	    else
+	    {
+		vgm.write_mem(0xC1, vgm.random(0xFFF), vgm.random(0xFF));
+	    }
+	}
+
+	vgm.wait(735);
+    }
+}
+
+// MultiPCM with its bank offsets being switched around constantly
+void genmultipcm(VGMWriter &vgm, const VGMGenSettings &settings)
+{
+    vgm.set_clock(0x88, 8053975);
+    vgm.write_rom_block(0x89, settings.bank_size, settings.bank_size);
+    vgm.set_loop();
+
+    writestorm(vgm, settings, [&] {
+	if (vgm.random(3) == 0)
+	{
+	    vgm.write8(0xC3);
+	    vgm.write8(vgm.random(27));
+	    vgm.write16((vgm.random(15) << 4));
+	}
+	else
+	{
+	    vgm.write_reg(0xB5, vgm.random(2), vgm.random(0xFF));
+	}
+    });
+}
+
+// Every chip at once, for ten times as long, with the DAC playing throughout
+void genall(VGMWriter &vgm, const VGMGenSettings &settings)
+{
+    vgm.set_clock(0x0C, 3579545);
+    vgm.set_header_word(0x28, 0x0009);
+    vgm.set_header_byte(0x2A, 16);
+    vgm.set_clock(0x10, 3579545);
+    vgm.set_clock(0x2C, 7670453);
+    vgm.set_clock(0x30, 3579545);
+    vgm.set_clock(0x38, 4000000);
+    vgm.set_header_long(0x3C, 0x000F8000);
+    vgm.set_clock(0x40, 12500000);
+    vgm.set_clock(0x44, 4000000);
+    vgm.set_clock(0x4C, 8000000);
+    vgm.set_clock(0x50, 3579545);
+    vgm.set_clock(0x54, 3579545);
+    vgm.set_clock(0x58, 3579545);
+    vgm.set_clock(0x5C, 14318180);
+    vgm.set_clock(0x68, 16934400);
+    vgm.set_clock(0x88, 8053975);
+
+    vgm.write_stream_block(0x00, settings.bank_size);
+    vgm.write_rom_block(0x80, settings.bank_size, settings.bank_size);
+    vgm.write_rom_block(0x82, settings.bank_size, settings.bank_size);
+    vgm.write_rom_block(0x86, settings.bank_size, settings.bank_size);
+    vgm.write_rom_block(0x89, settings.bank_size, settings.bank_size);
+    vgm.write_reg(0x52, 0x2B, 0x80);
+    vgm.write_reg(0x5F, 0x05, 0x01);
+    vgm.set_loop();
+
+    // Register write opcodes, with the range of registers that each chip has
+    const array<uint8_t, 3> reg_writes[] = {
+	{0x51, 0x00, 0x38}, {0x52, 0x21, 0xB6}, {0x53, 0x21, 0xB6}, {0x54, 0x01, 0xFF},
+	{0x55, 0x00, 0xB6}, {0x58, 0x00, 0xB6}, {0x59, 0x00, 0xB6}, {0x5A, 0x01, 0xF5},
+	{0x5B, 0x01, 0xF5}, {0x5C, 0x01, 0xF5}, {0x5D, 0x00, 0xFF}, {0x5E, 0x01, 0xF5},
+	{0x5F, 0x01, 0xF5}, {0xB0, 0x00, 0x08}, {0xB5, 0x00, 0x02},
+    };
+
+    uint32_t num_ticks = (settings.seconds * 60 * 10);
+    uint32_t bank_pos = 0;
+
+    for (uint32_t tick = 0; tick < num_ticks; tick++)
+    {
+	for (uint32_t i = 0; i < settings.density; i++)
+	{
+	    auto &reg_write = reg_writes[vgm.random((size(reg_writes) - 1))];
+	    vgm.write_reg(reg_write[0], vgm.random_range(reg_write[1], reg_write[2]), vgm.random(0xFF));
+	}
+
+	vgm.write8(0x50);
+	vgm.write8(vgm.random(0xFF));
+	vgm.write_mem(0xC0, vgm.random(0xFF), vgm.random(0xFF));
+
+	// Seek back to the start of the bank before it runs out
+	if ((tick == 0) || ((bank_pos + 49) > settings.bank_size))
+	{
+	    vgm.write8(0xE0);
+	    vgm.write32(0);
+	    bank_pos = 0;
+	}
+
+	// 735 samples' worth of DAC writes (49 writes of 15 samples each)
+	for (int i = 0; i < 49; i++)
+	{
+	    vgm.write_dac(15);
+	}
+
+	bank_pos += 49;
+    }
+}
+
+struct VGMGenScenario
+{
+    string name;
+    string description;
+    function<void(VGMWriter&, const VGMGenSettings&)> generate;
+};
+
+const vector<VGMGenScenario> scenarios = {
+    {"sn76489", "SN76489 register write storm", gensn76489},
+    {"ym2413", "YM2413 register write storm", genym2413},
+    {"ym2612", "YM2612 register write storm (both ports)", genym2612},
+    {"ym2612_dac", "YM2612 DAC writes (0x8n) on every sample, from a large data bank", genym2612dac},
+    {"ym2612_stream", "YM2612 DAC stream, plus a register write storm", genym2612stream},
+    {"ym2151", "YM2151 register write storm", genym2151},
+    {"ym2203", "YM2203 register write storm", genym2203},
+    {"ym2610", "YM2610 register write storm, with large ADPCM-A and ADPCM-B ROM blocks", genym2610},
+    {"ym3812", "YM3812 register write storm", genym3812},
+    {"ym3526", "YM3526 register write storm", genym3526},
+    {"y8950", "Y8950 register write storm, with a large Delta-T ROM block", geny8950},
+    {"ymf262", "YMF262 register write storm (OPL3 mode, both ports)", genymf262},
+    {"segapcm", "SegaPCM register write storm, with a large ROM block", gensegapcm},
+    {"ymz280b", "YMZ280B register write storm, with a large ROM block", genymz280b},
+    {"rf5c68", "RF5C68 RAM transfers (0x68), RAM writes and register writes", genrf5c68},
+    {"multipcm", "MultiPCM bank switches (0xC3) and register writes, with a large ROM block", genmultipcm},
+    {"all", "Every chip at once, ten times as long as the rest", genall},
+};
+
+// Number of frames rendered per call while checking a file
+constexpr size_t check_frames = 2048;
+
+// Makes sure the engine can play through the whole file without any errors
+bool checkfile(string filename, string &error)
+{
+    BeeVGM vgmcore;
+
+    if (!vgmcore.loadFile(filename))
+    {
+	error = vgmcore.getErrorString();
+	return false;
+    }
+
+    // Rendered (rather than just decoded), so that the DAC streams get run as well
+    array<int16_t, (check_frames * 2)> buffer;
+
+    while (vgmcore.render(buffer.data(), check_frames) == check_frames)
+    {
+	continue;
+    }
+
+    if (vgmcore.getError() != ErrorNone)
+    {
+	error = vgmcore.getErrorString();
+	return false;
+    }
+
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    VGMGenSettings settings;
+    string out_dir = ".";
+    vector<string> names;
+
+    for (int i = 1; i < argc; i++)
+    {
+	string arg = argv[i];
+
+	if ((arg == "-o") && ((i + 1) < argc))
+	{
+	    out_dir = argv[++i];
+	}
+	else if ((arg == "-s") && ((i + 1) < argc))
+	{
+	    settings.seconds = stoul(argv[++i]);
+	}
+	else if ((arg == "-d") && ((i + 1) < argc))
+	{
+	    settings.density = stoul(argv[++i]);
+	}
+	else if ((arg == "-b") && ((i + 1) < argc))
+	{
+	    settings.bank_size = max<uint32_t>((stoul(argv[++i]) * 1024), 0x2000);
+	}
+	else if ((arg == "-r") && ((i + 1) < argc))
+	{
+	    settings.seed = stoul(argv[++i]);
+	}
+	else if (arg == "-l")
+	{
+	    for (auto &scenario : scenarios)
+	    {
+		cout << scenario.name << " - " << scenario.description << endl;
+	    }
+
+	    return 0;
+	}
+	else if ((arg == "-h") || (arg == "--help"))
+	{
+	    cout << "Usage: vgmgen [-o output directory] [-s seconds] [-d writes per 1/60th of a second] [-b bank size in KiB] [-r seed] [-l] [scenarios...]" << endl;
+	    return 0;
+	}
+	else
+	{
+	    names.push_back(arg);
+	}
+    }
+
+    // All of the scenarios are generated if none were given
+    if (names.empty())
+    {
+	for (auto &scenario : scenarios)
+	{
+	    names.push_back(scenario.name);
+	}
+    }
+
+    // Only problems with the generated files are worth printing while checking them
+    BeeVGMLog::set_level(LogWarning);
+
+    int num_failed = 0;
+
+    for (auto &name : names)
+    {
+	auto scenario = find_if(scenarios.begin(), scenarios.end(), [&](const VGMGenScenario &s) {
+	    return (s.name == name);
+	});
+
+	if (scenario == scenarios.end())
+	{
+	    cout << "Unknown scenario " << name << " (use -l to list them)" << endl;
+	    num_failed += 1;
+	    continue;
+	}
+
+	// Each scenario gets its own random sequence, so they don't depend on which others were generated
+	VGMWriter vgm((settings.seed + uint32_t(distance(scenarios.begin(), scenario))));
+	scenario->generate(vgm, settings);
+
+	string filename = (out_dir + "/" + name + ".vgm");
+	string error;
+
+	if (!vgm.save(filename, scenario->description))
+	{
+	    cout << "[FAILED] " << filename << " (could not be written)" << endl;
+	    num_failed += 1;
+	}
+	else if (!checkfile(filename, error))
+	{
+	    cout << "[FAILED] " << filename << " (" << error << ")" << endl;
+	    num_failed += 1;
+	}
+	else
+	{
+	    cout << "[OK] " << filename << " (" << vgm.size() << " bytes)" << endl;
+	}
+    }
+
+    return (num_failed == 0) ? 0 : 1;
+}
@@ -0,0 +1,652 @@
+/*
+    This file is part of the BeeVGM engine.
+    Copyright (C) 2022 BueniaDev.
+
+    BeeVGM is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    BeeVGM is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with BeeVGM.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// BeeVGM's golden output regression checker
+//
+// Renders VGM files through the engine, and hashes the output of each chip
+// (before mixing) along with the final mix, so any change to the engine can
+// be checked against known-good output. With -u, the hashes are saved as the
+// new goldens instead.
+//
+// The hashes are kept for every 1024 frames, so a mismatch can be narrowed
+// down to the first block that changed. Goldens saved with -p also keep
+// each stream's raw samples, which pins a mismatch down to the exact sample,
+// and allows for a tolerance (-t) when a change isn't meant to be bit-exact
+// (a new resampler, say).
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <memory>
+#include <algorithm>
+#include <filesystem>
+#include <cstdio>
+#include <cstdlib>
+#include "beevgm.h"
+using namespace beevgm;
+using namespace std;
+
+// Number of frames rendered per call (the same as in vgm2wav)
+constexpr size_t render_frames = 2048;
+
+// Number of frames covered by each block hash
+constexpr uint32_t hash_block_frames = 1024;
+
+constexpr uint64_t fnv_offset_basis = 0xCBF29CE484222325ULL;
+constexpr uint64_t fnv_prime = 0x100000001B3ULL;
+
+struct VerifySettings
+{
+    string golden_dir = "goldens";
+    bool is_update = false;
+    bool is_save_pcm = false;
+    int32_t tolerance = 0;
+    size_t num_threads = 1;
+    uint32_t max_seconds = 600;
+};
+
+string chipname(BeeVGMChipID chip_id)
+{
+    switch (chip_id)
+    {
+	case ChipSN76489: return "SN76489";
+	case ChipYM2413: return "YM2413";
+	case ChipYM2612: return "YM2612";
+	case ChipYM2151: return "YM2151";
+	case ChipSegaPCM: return "SegaPCM";
+	case ChipRF5C68: return "RF5C68";
+	case ChipYM2203: return "YM2203";
+	case ChipYM2610: return "YM2610";
+	case ChipYM3812: return "YM3812";
+	case ChipYM3526: return "YM3526";
+	case ChipY8950: return "Y8950";
+	case ChipYMF262: return "YMF262";
+	case ChipYMZ280B: return "YMZ280B";
+	case ChipMultiPCM: return "MultiPCM";
+	default: return "Unknown";
+    }
+}
+
+// Output of one chip (or of the final mix), as hashes and, optionally, the
+// samples themselves (which are compared against a reference as they come in)
+class VerifyStream
+{
+    public:
+	VerifyStream(string stream_name) : name(stream_name)
+	{
+
+	}
+
+	string name;
+	uint64_t num_frames = 0;
+	uint64_t hash = fnv_offset_basis;
+	vector<uint64_t> block_hashes;
+
+	// Saves the samples to 'filename' as they're added
+	bool save_samples(string filename)
+	{
+	    out_pcm.open(filename.c_str(), ios::out | ios::binary);
+	    return out_pcm.is_open();
+	}
+
+	// Compares the samples against the ones saved in 'filename' as they're added
+	bool compare_samples(string filename, int32_t tolerance)
+	{
+	    ref_pcm.open(filename.c_str(), ios::in | ios::binary);
+	    max_tolerance = tolerance;
+	    return ref_pcm.is_open();
+	}
+
+	bool is_compared() const
+	{
+	    return ref_pcm.is_open();
+	}
+
+	void add(const int32_t *left, const int32_t *right, size_t frames)
+	{
+	    for (size_t i = 0; i < frames; i++)
+	    {
+		add_frame(left[i], right[i]);
+	    }
+	}
+
+	void add(const int16_t *samples, size_t frames)
+	{
+	    for (size_t i = 0; i < frames; i++)
+	    {
+		add_frame(samples[(i * 2)], samples[((i * 2) + 1)]);
+	    }
+	}
+
+	// Pads the stream with silence up to 'frame' (for chips that didn't play from the start)
+	void pad_to(uint64_t frame)
+	{
+	    while (num_frames < frame)
+	    {
+		add_frame(0, 0);
+	    }
+	}
+
+	void finish()
+	{
+	    if (block_frames != 0)
+	    {
+		block_hashes.push_back(block_hash);
+		block_hash = fnv_offset_basis;
+		block_frames = 0;
+	    }
+
+	    out_pcm.close();
+
+	    // Any samples left in the reference mean this stream came up short
+	    if (ref_pcm.is_open() && (ref_pcm.peek() != char_traits<char>::eof()))
+	    {
+		is_ref_longer = true;
+	    }
+	}
+
+	// First sample that's further from the reference than the tolerance allows
+	bool is_diff_found = false;
+	uint64_t diff_frame = 0;
+	int diff_channel = 0;
+	int32_t diff_expected = 0;
+	int32_t diff_actual = 0;
+	// Largest difference from the reference anywhere in the stream
+	int64_t max_diff = 0;
+	bool is_ref_longer = false;
+	bool is_ref_shorter = false;
+
+    private:
+	uint64_t block_hash = fnv_offset_basis;
+	uint32_t block_frames = 0;
+
+	ofstream out_pcm;
+	ifstream ref_pcm;
+	int32_t max_tolerance = 0;
+
+	static uint64_t hash_sample(uint64_t current, int32_t sample)
+	{
+	    uint32_t value = uint32_t(sample);
+
+	    for (int i = 0; i < 4; i++)
+	    {
+		current ^= ((value >> (i * 8)) & 0xFF);
+		current *= fnv_prime;
+	    }
+
+	    return current;
+	}
+
+	static void write_sample(ostream &out, int32_t sample)
+	{
+	    uint32_t value = uint32_t(sample);
+	    char bytes[4];
+
+	    for (int i = 0; i < 4; i++)
+	    {
+		bytes[i] = ((value >> (i * 8)) & 0xFF);
+	    }
+
+	    out.write(bytes, 4);
+	}
+
+	static bool read_sample(istream &in, int32_t &sample)
+	{
+	    uint8_t bytes[4];
+
+	    if (!in.read((char*)bytes, 4))
+	    {
+		return false;
+	    }
+
+	    sample = int32_t((bytes[3] << 24) | (bytes[2] << 16) | (bytes[1] << 8) | bytes[0]);
+	    return true;
+	}
+
+	void add_frame(int32_t left, int32_t right)
+	{
+	    array<int32_t, 2> frame = {left, right};
+
+	    for (int channel = 0; channel < 2; channel++)
+	    {
+		hash = hash_sample(hash, frame[channel]);
+		block_hash = hash_sample(block_hash, frame[channel]);
+
+		if (out_pcm.is_open())
+		{
+		    write_sample(out_pcm, frame[channel]);
+		}
+
+		if (ref_pcm.is_open() && !is_ref_shorter)
+		{
+		    compare_sample(channel, frame[channel]);
+		}
+	    }
+
+	    num_frames += 1;
+
+	    if (++block_frames == hash_block_frames)
+	    {
+		block_hashes.push_back(block_hash);
+		block_hash = fnv_offset_basis;
+		block_frames = 0;
+	    }
+	}
+
+	void compare_sample(int channel, int32_t sample)
+	{
+	    int32_t expected = 0;
+
+	    if (!read_sample(ref_pcm, expected))
+	    {
+		is_ref_shorter = true;
+		return;
+	    }
+
+	    int64_t diff = llabs((int64_t(sample) - int64_t(expected)));
+	    max_diff = max(max_diff, diff);
+
+	    if ((diff > max_tolerance) && !is_diff_found)
+	    {
+		is_diff_found = true;
+		diff_frame = num_frames;
+		diff_channel = channel;
+		diff_expected = expected;
+		diff_actual = sample;
+	    }
+	}
+};
+
+struct VerifyGolden
+{
+    string name;
+    uint64_t num_frames = 0;
+    uint64_t hash = 0;
+    vector<uint64_t> block_hashes;
+};
+
+string goldenpath(const VerifySettings &settings, string filename)
+{
+    size_t slash_pos = filename.find_last_of("/\\");
+    string basename = (slash_pos == string::npos) ? filename : filename.substr((slash_pos + 1));
+    return (settings.golden_dir + "/" + basename + ".golden");
+}
+
+string pcmpath(string golden_path, string stream_name)
+{
+    return (golden_path + "." + stream_name + ".pcm");
+}
+
+// Goldens are saved as text, one stream per line:
+// name, number of frames, hash of the whole stream, then the block hashes
+bool loadgoldens(string filename, vector<VerifyGolden> &goldens)
+{
+    ifstream file(filename.c_str());
+
+    if (!file.is_open())
+    {
+	return false;
+    }
+
+    string line;
+
+    while (getline(file, line))
+    {
+	if (line.empty() || (line[0] == '#'))
+	{
+	    continue;
+	}
+
+	istringstream fields(line);
+	VerifyGolden golden;
+	fields >> golden.name >> dec >> golden.num_frames >> hex >> golden.hash;
+
+	uint64_t block_hash = 0;
+
+	while (fields >> hex >> block_hash)
+	{
+	    golden.block_hashes.push_back(block_hash);
+	}
+
+	goldens.push_back(golden);
+    }
+
+    return true;
+}
+
+bool savegoldens(string filename, string vgm_filename, const vector<unique_ptr<VerifyStream>> &streams)
+{
+    ofstream file(filename.c_str());
+
+    if (!file.is_open())
+    {
+	return false;
+    }
+
+    file << "# BeeVGM golden output for " << vgm_filename << endl;
+
+    for (auto &stream : streams)
+    {
+	file << stream->name << " " << dec << stream->num_frames << " " << hex << setw(16) << setfill('0') << stream->hash;
+
+	for (auto block_hash : stream->block_hashes)
+	{
+	    file << " " << setw(16) << setfill('0') << block_hash;
+	}
+
+	file << endl;
+    }
+
+    return file.good();
+}
+
+// Checks one stream against its golden, and adds a description of any problem to 'problems'
+bool checkstream(const VerifyStream &stream, const VerifyGolden &golden, vector<string> &problems)
+{
+    ostringstream problem;
+    problem << stream.name << ": ";
+
+    // Samples saved with the golden give the exact first difference (allowing for the tolerance)
+    if (stream.is_compared())
+    {
+	if (stream.is_diff_found)
+	{
+	    problem << "first differs at frame " << stream.diff_frame << " (" << ((stream.diff_channel == 0) ? "left" : "right");
+	    problem << ", expected " << stream.diff_expected << ", got " << stream.diff_actual << ")";
+	    problems.push_back(problem.str());
+	    return false;
+	}
+	else if (stream.is_ref_longer || stream.is_ref_shorter || (stream.num_frames != golden.num_frames))
+	{
+	    problem << "length differs (expected " << golden.num_frames << " frames, got " << stream.num_frames << ")";
+	    problems.push_back(problem.str());
+	    return false;
+	}
+
+	return true;
+    }
+
+    if (stream.hash == golden.hash)
+    {
+	return true;
+    }
+
+    size_t num_blocks = min(stream.block_hashes.size(), golden.block_hashes.size());
+
+    for (size_t index = 0; index < num_blocks; index++)
+    {
+	if (stream.block_hashes[index] != golden.block_hashes[index])
+	{
+	    uint64_t start_frame = (uint64_t(index) * hash_block_frames);
+	    problem << "first differs in frames " << start_frame << "-" << (start_frame + hash_block_frames - 1);
+	    problems.push_back(problem.str());
+	    return false;
+	}
+    }
+
+    problem << "length differs (expected " << golden.num_frames << " frames, got " << stream.num_frames << ")";
+    problems.push_back(problem.str());
+    return false;
+}
+
+void printusage()
+{
+    cout << "Usage: vgmverify [-g golden directory] [-u] [-p] [-t tolerance] [-j render threads] [-s max seconds] [VGM files...]" << endl;
+    cout << "    -u saves the output as the new goldens (along with the samples, with -p)" << endl;
+    cout << "    -t allows samples to differ by up to this much (needs goldens saved with -p)" << endl;
+}
+
+bool verifyfile(BeeVGM &vgmcore, const VerifySettings &settings, string filename)
+{
+    string golden_path = goldenpath(settings, filename);
+    vector<VerifyGolden> goldens;
+
+    if (!settings.is_update && !loadgoldens(golden_path, goldens))
+    {
+	cout << "[FAILED] " << filename << " (no golden at " << golden_path << ")" << endl;
+	return false;
+    }
+
+    if (!vgmcore.loadFile(filename))
+    {
+	cout << "[FAILED] " << filename << " (" << vgmcore.getErrorString() << ")" << endl;
+	return false;
+    }
+
+    vector<unique_ptr<VerifyStream>> streams;
+
+    auto get_stream = [&](string name) -> VerifyStream& {
+	for (auto &stream : streams)
+	{
+	    if (stream->name == name)
+	    {
+		return *stream;
+	    }
+	}
+
+	streams.push_back(make_unique<VerifyStream>(name));
+	VerifyStream &stream = *streams.back();
+
+	if (settings.is_update && settings.is_save_pcm)
+	{
+	    stream.save_samples(pcmpath(golden_path, name));
+	}
+	else if (settings.is_update)
+	{
+	    // Samples from an older golden would be out of date
+	    remove(pcmpath(golden_path, name).c_str());
+	}
+	else if (!settings.is_update)
+	{
+	    // Samples are only there if the golden was saved with -p
+	    stream.compare_samples(pcmpath(golden_path, name), settings.tolerance);
+	}
+
+	return stream;
+    };
+
+    VerifyStream &mix_stream = get_stream("mix");
+    uint64_t frame_pos = 0;
+
+    // Chips can start partway through a render() call (say, when one is
+    // detected on its first write), so each block is padded out to where it starts
+    vgmcore.setChipTap([&](BeeVGMChipID chip_id, int instance, uint64_t block_pos, const int32_t *left, const int32_t *right, size_t num_frames) {
+	VerifyStream &stream = get_stream((chipname(chip_id) + "." + to_string(instance)));
+	stream.pad_to(block_pos);
+	stream.add(left, right, num_frames);
+    });
+
+    array<int16_t, (render_frames * 2)> render_buffer;
+    uint64_t max_frames = (uint64_t(settings.max_seconds) * 44100);
+
+    while (frame_pos < max_frames)
+    {
+	size_t block_frames = vgmcore.render(render_buffer.data(), render_frames);
+	mix_stream.add(render_buffer.data(), block_frames);
+	frame_pos += block_frames;
+
+	if (block_frames < render_frames)
+	{
+	    break;
+	}
+    }
+
+    vgmcore.setChipTap(nullptr);
+
+    // Output from a file that didn't play properly isn't worth saving or checking
+    if (vgmcore.getError() != ErrorNone)
+    {
+	cout << "[FAILED] " << filename << " (" << vgmcore.getErrorString() << ")" << endl;
+	return false;
+    }
+
+    for (auto &stream : streams)
+    {
+	stream->finish();
+    }
+
+    if (settings.is_update)
+    {
+	if (!savegoldens(golden_path, filename, streams))
+	{
+	    cout << "[FAILED] " << filename << " (could not write " << golden_path << ")" << endl;
+	    return false;
+	}
+
+	cout << "[SAVED] " << filename << " (" << streams.size() << " streams, " << frame_pos << " frames)" << endl;
+	return true;
+    }
+
+    vector<string> problems;
+
+    for (auto &golden : goldens)
+    {
+	auto stream = find_if(streams.begin(), streams.end(), [&](const unique_ptr<VerifyStream> &s) {
+	    return (s->name == golden.name);
+	});
+
+	if (stream == streams.end())
+	{
+	    problems.push_back((golden.name + ": missing"));
+	    continue;
+	}
+
+	checkstream(**stream, golden, problems);
+    }
+
+    for (auto &stream : streams)
+    {
+	auto golden = find_if(goldens.begin(), goldens.end(), [&](const VerifyGolden &g) {
+	    return (g.name == stream->name);
+	});
+
+	if (golden == goldens.end())
+	{
+	    problems.push_back((stream->name + ": not in the golden"));
+	}
+    }
+
+    if (!problems.empty())
+    {
+	cout << "[FAILED] " << filename << endl;
+
+	for (auto &problem : problems)
+	{
+	    cout << "    " << problem << endl;
+	}
+
+	return false;
+    }
+
+    int64_t max_diff = 0;
+
+    for (auto &stream : streams)
+    {
+	max_diff = max(max_diff, stream->max_diff);
+    }
+
+    cout << "[OK] " << filename;
+
+    if (max_diff != 0)
+    {
+	cout << " (within tolerance, largest difference " << max_diff << ")";
+    }
+
+    cout << endl;
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    VerifySettings settings;
+    vector<string> files;
+
+    for (int i = 1; i < argc; i++)
+    {
+	string arg = argv[i];
+
+	if ((arg == "-g") && ((i + 1) < argc))
+	{
+	    settings.golden_dir = argv[++i];
+	}
+	else if (arg == "-u")
+	{
+	    settings.is_update = true;
+	}
+	else if (arg == "-p")
+	{
+	    settings.is_save_pcm = true;
+	}
+	else if ((arg == "-t") && ((i + 1) < argc))
+	{
+	    settings.tolerance = stoi(argv[++i]);
+	}
+	else if ((arg == "-j") && ((i + 1) < argc))
+	{
+	    settings.num_threads = stoul(argv[++i]);
+	}
+	else if ((arg == "-s") && ((i + 1) < argc))
+	{
+	    settings.max_seconds = stoul(argv[++i]);
+	}
+	else if ((arg == "-h") || (arg == "--help"))
+	{
+	    printusage();
+	    return 0;
+	}
+	else
+	{
+	    files.push_back(arg);
+	}
+    }
+
+    if (files.empty())
+    {
+	printusage();
+	return 1;
+    }
+
+    // New goldens (and their samples) can go into a directory that isn't there yet
+    if (settings.is_update)
+    {
+	error_code ec;
+	filesystem::create_directories(settings.golden_dir, ec);
+    }
+
+    BeeVGMLog::set_level(LogWarning);
+
+    BeeVGM vgmcore;
+    vgmcore.setRenderThreads(settings.num_threads);
+
+    int num_failed = 0;
+
+    for (auto &file : files)
+    {
+	// Only one file is checked at a time, so each one gets its own warnings
+	BeeVGMLog::reset_repeats();
+
+	if (!verifyfile(vgmcore, settings, file))
+	{
+	    num_failed += 1;
+	}
+    }
+
+    cout << (files.size() - num_failed) << " of " << files.size() << " files passed" << endl;
+    return (num_failed == 0) ? 0 : 1;
+}